@@ -0,0 +1,248 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BATCH_EVAL_AVX2 1
+#else
+#define BATCH_EVAL_AVX2 0
+#endif
+
+#include "../Models/PositionBatch.h"
+#include "Logic.h"
+
+// calc_score of many independent positions at once, for analysis, tuning and labelling data sets.
+// The positions are bit masks (position_batch); with AVX2 four of them are scored per instruction,
+// otherwise one by one with bit counting. The processor is checked at run time, so one binary runs
+// everywhere. The results are bit for bit those of calc_score: every sum is made in the same order,
+// a man adding 1 and then its advancement cell by cell (as long as the compiler does not fuse multiplies
+// and adds in calc_score itself, e.g. -ffp-contract=fast with FMA enabled).
+template <class V>
+class BasicBatchEval
+{
+public:
+    // positions per chunk of the threads
+    static const size_t Chunk = 4096;
+
+    // Appends the position mtx, scored for color (first_bot_color of calc_score)
+    static void add(position_batch& batch, const vector<vector<POS_T>>& mtx, const bool color)
+    {
+        uint64_t masks[5] = { 0, 0, 0, 0, 0 };
+        for (POS_T i = 0; i < V::Size; ++i)
+        {
+            for (POS_T j = 0; j < V::Size; ++j)
+            {
+                if (mtx[i][j] && (i + j) % 2)
+                    masks[mtx[i][j]] |= uint64_t(1) << (i * Row_squares + j / 2);
+            }
+        }
+        batch.white_men.push_back(masks[1]);
+        batch.black_men.push_back(masks[2]);
+        batch.white_queens.push_back(masks[3]);
+        batch.black_queens.push_back(masks[4]);
+        batch.color.push_back(color);
+    }
+
+    // whether evaluate can use AVX2 on this processor
+    static bool has_avx2()
+    {
+#if BATCH_EVAL_AVX2
+        static const bool res = __builtin_cpu_supports("avx2");
+        return res;
+#else
+        return false;
+#endif
+    }
+
+    // Scores the positions begin..end - 1 of batch into the same places of out; potential - the
+    // NumberAndPotential scoring. simd - AVX2 if the processor has it.
+    static void evaluate(const position_batch& batch, double* out, const bool potential, const size_t begin,
+        const size_t end, const bool simd = true)
+    {
+        size_t done = begin;
+#if BATCH_EVAL_AVX2
+        if (simd && has_avx2())
+            done = potential ? evaluate_avx2<true>(batch, out, begin, end) : evaluate_avx2<false>(batch, out, begin, end);
+#else
+        (void)simd;
+#endif
+        for (size_t i = done; i < end; ++i)
+        {
+            out[i] = potential ? score<true>(batch, i) : score<false>(batch, i);
+        }
+    }
+
+    // All positions of batch on threads, each taking the next Chunk positions
+    static vector<double> evaluate(const position_batch& batch, const bool potential, const size_t threads = 1,
+        const bool simd = true)
+    {
+        vector<double> res(batch.size());
+        atomic<size_t> next{ 0 };
+        const auto run = [&] {
+            for (size_t begin = next.fetch_add(Chunk); begin < res.size(); begin = next.fetch_add(Chunk))
+                evaluate(batch, res.data(), potential, begin, std::min(begin + Chunk, res.size()), simd);
+        };
+        vector<thread> helpers;
+        for (size_t i = 1; i < std::min(threads, (res.size() + Chunk - 1) / Chunk); ++i)
+            helpers.emplace_back(run);
+        run();
+        for (auto& helper : helpers)
+            helper.join();
+        return res;
+    }
+
+private:
+    static constexpr int Row_squares = V::Size / 2;
+    static constexpr int Cells = V::Size * Row_squares;
+
+    template <bool Potential> static double score(const position_batch& batch, const size_t i)
+    {
+        double w = 0, b = 0;
+        if constexpr (Potential)
+        {
+            for (uint64_t m = batch.white_men[i]; m; m &= m - 1)
+            {
+                w += 1;
+                w += 0.05 * double(V::Size - 1 - lowest_bit(m) / Row_squares);
+            }
+            for (uint64_t m = batch.black_men[i]; m; m &= m - 1)
+            {
+                b += 1;
+                b += 0.05 * double(lowest_bit(m) / Row_squares);
+            }
+        }
+        else
+        {
+            w = bit_count(batch.white_men[i]);
+            b = bit_count(batch.black_men[i]);
+        }
+        double wq = bit_count(batch.white_queens[i]), bq = bit_count(batch.black_queens[i]);
+        if (!batch.color[i])
+        {
+            swap(b, w);
+            swap(bq, wq);
+        }
+        if (w + wq == 0)
+            return INF;
+        if (b + bq == 0)
+            return 0;
+        const int q_coef = Potential ? 5 : 4;
+        return (b + bq * q_coef) / (w + wq * q_coef);
+    }
+
+    static int bit_count(uint64_t m)
+    {
+#if defined(__GNUC__)
+        return __builtin_popcountll(m);
+#else
+        int res = 0;
+        for (; m; m &= m - 1)
+            ++res;
+        return res;
+#endif
+    }
+
+    static int lowest_bit(const uint64_t m)
+    {
+#if defined(__GNUC__)
+        return __builtin_ctzll(m);
+#else
+        int res = 0;
+        while (!(m >> res & 1))
+            ++res;
+        return res;
+#endif
+    }
+
+#if BATCH_EVAL_AVX2
+    // Four positions per step, one in each lane. Counts are exact in any order, so men without the
+    // potential and queens are bit counts; the men with the potential are summed as in score(), over
+    // the cells where any of the four has one (adding 0 for the others changes nothing). Returns the
+    // first position left for the scalar code.
+    template <bool Potential>
+    __attribute__((target("avx2"))) static size_t evaluate_avx2(const position_batch& batch, double* out,
+        size_t begin, const size_t end)
+    {
+        const __m256d one = _mm256_set1_pd(1), zero = _mm256_setzero_pd(), inf = _mm256_set1_pd(INF);
+        const __m256d step = _mm256_set1_pd(0.05), q_coef = _mm256_set1_pd(Potential ? 5 : 4);
+        for (; begin + 4 <= end; begin += 4)
+        {
+            const __m256i wm = load_avx2(batch.white_men, begin), bm = load_avx2(batch.black_men, begin);
+            __m256d w = zero, b = zero;
+            if constexpr (Potential)
+            {
+                for (uint64_t cells = any_of_four(batch.white_men, begin); cells; cells &= cells - 1)
+                {
+                    const int k = lowest_bit(cells);
+                    const __m256d is_man = cell_avx2(wm, k, one);
+                    w = _mm256_add_pd(w, is_man);
+                    w = _mm256_add_pd(w, _mm256_mul_pd(_mm256_mul_pd(step, is_man),
+                                                       _mm256_set1_pd(V::Size - 1 - k / Row_squares)));
+                }
+                for (uint64_t cells = any_of_four(batch.black_men, begin); cells; cells &= cells - 1)
+                {
+                    const int k = lowest_bit(cells);
+                    const __m256d is_man = cell_avx2(bm, k, one);
+                    b = _mm256_add_pd(b, is_man);
+                    b = _mm256_add_pd(b, _mm256_mul_pd(_mm256_mul_pd(step, is_man), _mm256_set1_pd(k / Row_squares)));
+                }
+            }
+            else
+            {
+                w = bit_count_avx2(wm);
+                b = bit_count_avx2(bm);
+            }
+            __m256d wq = bit_count_avx2(load_avx2(batch.white_queens, begin));
+            __m256d bq = bit_count_avx2(load_avx2(batch.black_queens, begin));
+            // the lanes scored for white take the sides the other way round
+            const __m256d white = _mm256_castsi256_pd(_mm256_set_epi64x(
+                batch.color[begin + 3] ? 0 : -1, batch.color[begin + 2] ? 0 : -1, batch.color[begin + 1] ? 0 : -1,
+                batch.color[begin] ? 0 : -1));
+            const __m256d own = _mm256_blendv_pd(w, b, white), other = _mm256_blendv_pd(b, w, white);
+            const __m256d own_q = _mm256_blendv_pd(wq, bq, white), other_q = _mm256_blendv_pd(bq, wq, white);
+            __m256d res = _mm256_div_pd(_mm256_add_pd(other, _mm256_mul_pd(other_q, q_coef)),
+                _mm256_add_pd(own, _mm256_mul_pd(own_q, q_coef)));
+            res = _mm256_blendv_pd(res, zero, _mm256_cmp_pd(_mm256_add_pd(other, other_q), zero, _CMP_EQ_OQ));
+            res = _mm256_blendv_pd(res, inf, _mm256_cmp_pd(_mm256_add_pd(own, own_q), zero, _CMP_EQ_OQ));
+            _mm256_storeu_pd(out + begin, res);
+        }
+        return begin;
+    }
+
+    static uint64_t any_of_four(const vector<uint64_t>& masks, const size_t begin)
+    {
+        return masks[begin] | masks[begin + 1] | masks[begin + 2] | masks[begin + 3];
+    }
+
+    __attribute__((target("avx2"))) static __m256i load_avx2(const vector<uint64_t>& masks, const size_t begin)
+    {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(masks.data() + begin));
+    }
+
+    // 1 in the lanes where masks has the bit k, 0 elsewhere
+    __attribute__((target("avx2"))) static __m256d cell_avx2(const __m256i masks, const int k, const __m256d one)
+    {
+        const __m256i bit = _mm256_set1_epi64x(int64_t(1) << k);
+        return _mm256_and_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(masks, bit), bit)), one);
+    }
+
+    // bits of each lane as a double: nibbles looked up in a table of their bit counts and summed per lane
+    __attribute__((target("avx2"))) static __m256d bit_count_avx2(const __m256i masks)
+    {
+        const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3,
+                                               1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        const __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(masks, nibble)),
+            _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(masks, 4), nibble)));
+        // the sums (at most 64) become the low bits of the mantissa of 2^52
+        const __m256i sums = _mm256_sad_epu8(counts, _mm256_setzero_si256());
+        const __m256d two_52 = _mm256_set1_pd(4503599627370496.0);
+        return _mm256_sub_pd(_mm256_or_pd(_mm256_castsi256_pd(sums), two_52), two_52);
+    }
+#endif
+};
+
+typedef BasicBatchEval<Russian> BatchEval;
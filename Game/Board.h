@@ -1,10 +1,17 @@
 #pragma once
+#include <chrono>
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <vector>
 
 #include "../Models/Move.h"
 #include "../Models/Project_path.h"
+#include "../Models/Variant.h"
+#include "History.h"
+#include "Renderer.h"
+#include "Textures.h"
+#include "Trace.h"
 
 #ifdef __APPLE__
 #include <SDL2/SDL.h>
@@ -16,22 +23,41 @@
 
 using namespace std;
 
-class Board
+// Board of the draughts variant V (see Variant.h): the position, its history and the window
+template <class V>
+class BasicBoard
 {
 public:
-    Board() = default;
-    Board(const unsigned int W, const unsigned int H) : W(W), H(H)
+    BasicBoard() = default;
+    // texture_cache - keep the decoded pictures in Textures/textures.cache for a fast start,
+    // render_thread - draw on a thread of its own, see Renderer.h
+    BasicBoard(const unsigned int W, const unsigned int H, const bool texture_cache = false, const bool render_thread = false)
+        : W(W), H(H), texture_cache(texture_cache), render_thread(render_thread)
     {
     }
 
-    // draws start board
+    // draws start board. The pictures are decoded on worker threads while SDL, the window and
+    // the renderer come up; the time of every phase goes to log.txt.
     int start_draw()
     {
-        if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
+        Trace::Span span("start_draw");
+        const auto start = chrono::steady_clock::now();
+        auto last = start;
+        string timings;
+        auto phase = [&](const string& name) {
+            const auto now = chrono::steady_clock::now();
+            timings += " " + name + " " + to_string(int(chrono::duration<double, milli>(now - last).count())) + " ms,";
+            last = now;
+        };
+        loader = make_unique<TextureLoader>(textures_path, texture_cache);
+
+        // only video (with events) is used: the other subsystems take time to start
+        if (SDL_Init(SDL_INIT_VIDEO) != 0)
         {
             print_exception("SDL_Init can't init SDL2 lib");
             return 1;
         }
+        phase("sdl_init");
         if (W == 0 || H == 0)
         {
             SDL_DisplayMode dm;
@@ -50,42 +76,61 @@ public:
             print_exception("SDL_CreateWindow can't create window");
             return 1;
         }
-        ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-        if (ren == nullptr)
-        {
-            print_exception("SDL_CreateRenderer can't create renderer");
-            return 1;
-        }
-        board = IMG_LoadTexture(ren, board_path.c_str());
-        w_piece = IMG_LoadTexture(ren, piece_white_path.c_str());
-        b_piece = IMG_LoadTexture(ren, piece_black_path.c_str());
-        w_queen = IMG_LoadTexture(ren, queen_white_path.c_str());
-        b_queen = IMG_LoadTexture(ren, queen_black_path.c_str());
-        back = IMG_LoadTexture(ren, back_path.c_str());
-        replay = IMG_LoadTexture(ren, replay_path.c_str());
-        if (!board || !w_piece || !b_piece || !w_queen || !b_queen || !back || !replay)
-        {
-            print_exception("IMG_LoadTexture can't load main textures from " + textures_path);
+        phase("window");
+#ifdef __APPLE__
+        // AppKit draws on the main thread only
+        const bool threaded = false;
+#else
+        const bool threaded = render_thread;
+#endif
+        // the renderer logs its errors
+        if (!renderer.start(win, *loader, project_path, threaded))
             return 1;
-        }
-        SDL_GetRendererOutputSize(ren, &W, &H);
+        phase(string("renderer and textures (") + (loader->from_cache ? "cached" : "decoded") + ", waited " +
+              to_string(int(loader->wait_ms)) + " ms" + (threaded ? ", render thread" : "") + ")");
+        // in the units of the mouse events, the renderer draws in pixels
+        SDL_GetWindowSize(win, &W, &H);
         make_start_mtx();
         rerender();
+        phase("first_frame");
+
+        ofstream fout(project_path + "log.txt", ios_base::app);
+        fout << "Startup:" << timings << " total "
+             << int(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count()) << " ms\n";
         return 0;
     }
 
+    // text after the name of the game in the window title, e.g. the clock
+    void set_title(const string& text)
+    {
+        if (win)
+            SDL_SetWindowTitle(win, ("Checkers" + (text.empty() ? "" : "  " + text)).c_str());
+    }
+
     void redraw()
     {
         game_results = -1;
         history_mtx.clear();
         history_beat_series.clear();
+        history.clear();
+        sliding_hops.clear();
         make_start_mtx();
         clear_active();
         clear_highlight();
     }
 
-    void move_piece(move_pos turn, const int beat_series = 0)
+    // slide_ms - how long the hop slides on the screen (0 - at once); the slides of hops made one after
+    // another are played in turn, while the game goes on
+    void move_piece(move_pos turn, const int beat_series = 0, const double slide_ms = 0)
     {
+        if (slide_ms > 0)
+        {
+            auto start = chrono::steady_clock::now();
+            if (!sliding_hops.empty())
+                start = max(start, sliding_hops.back().start + chrono::microseconds(int64_t(sliding_hops.back().ms * 1000)));
+            sliding_hops.push_back({ turn, mtx[turn.x][turn.y], turn.xb != -1 ? mtx[turn.xb][turn.yb] : POS_T(0), start,
+                                     slide_ms });
+        }
         if (turn.xb != -1)
         {
             mtx[turn.xb][turn.yb] = 0;
@@ -103,11 +148,27 @@ public:
         {
             throw runtime_error("begin position is empty, can't move");
         }
-        if ((mtx[i][j] == 1 && i2 == 0) || (mtx[i][j] == 2 && i2 == 7))
+        const bool reversible = (mtx[i][j] > 2 && !beat_series);
+        // without promotion during capture series it is done by finish_series
+        if ((V::Promote_during_capture || !beat_series) && is_promotion(mtx[i][j], i2))
             mtx[i][j] += 2;
         mtx[i2][j2] = mtx[i][j];
         drop_piece(i, j);
-        add_history(beat_series);
+        // white pieces are odd, so after a white move black (1) is to move
+        add_history(mtx[i2][j2] % 2, beat_series, reversible);
+    }
+
+    // The capture series ended on (i, j). In variants without promotion during capture series
+    // a man that ended it on the last row becomes a queen now.
+    void finish_series(const POS_T i, const POS_T j)
+    {
+        if (V::Promote_during_capture || !is_promotion(mtx[i][j], i))
+            return;
+        mtx[i][j] += 2;
+        history_mtx.back() = mtx;
+        history.pop();
+        history.push(Zobrist::hash(mtx, mtx[i][j] % 2), false);
+        rerender();
     }
 
     void drop_piece(const POS_T i, const POS_T j)
@@ -142,9 +203,9 @@ public:
 
     void clear_highlight()
     {
-        for (POS_T i = 0; i < 8; ++i)
+        for (POS_T i = 0; i < V::Size; ++i)
         {
-            is_highlighted_[i].assign(8, 0);
+            is_highlighted_[i].assign(V::Size, 0);
         }
         rerender();
     }
@@ -175,8 +236,10 @@ public:
         {
             history_mtx.pop_back();
             history_beat_series.pop_back();
+            history.pop();
         }
         mtx = *(history_mtx.rbegin());
+        sliding_hops.clear();
         clear_highlight();
         clear_active();
     }
@@ -190,141 +253,78 @@ public:
     // use if window size changed
     void reset_window_size()
     {
-        SDL_GetRendererOutputSize(ren, &W, &H);
+        SDL_GetWindowSize(win, &W, &H);
         rerender();
     }
 
+    // Stops the render and texture threads and closes the window; the destructor does it unless it was done
     void quit()
     {
-        SDL_DestroyTexture(board);
-        SDL_DestroyTexture(w_piece);
-        SDL_DestroyTexture(b_piece);
-        SDL_DestroyTexture(w_queen);
-        SDL_DestroyTexture(b_queen);
-        SDL_DestroyTexture(back);
-        SDL_DestroyTexture(replay);
-        SDL_DestroyRenderer(ren);
-        SDL_DestroyWindow(win);
+        renderer.stop();
+        if (win)
+            SDL_DestroyWindow(win);
+        win = nullptr;
+        // waits for the cache to be written
+        loader.reset();
+        IMG_Quit();
         SDL_Quit();
     }
 
-    ~Board()
+    ~BasicBoard()
     {
         if (win)
             quit();
     }
 
 private:
-    void add_history(const int beat_series = 0)
+    // whether a man of the piece type becomes a queen on row x
+    static bool is_promotion(const POS_T type, const POS_T x)
+    {
+        return (type == 1 && x == 0) || (type == 2 && x == V::Size - 1);
+    }
+
+    void add_history(const bool color, const int beat_series = 0, const bool reversible = false)
     {
         history_mtx.push_back(mtx);
         history_beat_series.push_back(beat_series);
+        history.push(Zobrist::hash(mtx, color), reversible);
     }
     // function to make start matrix
     void make_start_mtx()
     {
-        for (POS_T i = 0; i < 8; ++i)
+        for (POS_T i = 0; i < V::Size; ++i)
         {
-            for (POS_T j = 0; j < 8; ++j)
+            for (POS_T j = 0; j < V::Size; ++j)
             {
                 mtx[i][j] = 0;
-                if (i < 3 && (i + j) % 2 == 1)
+                if (i < V::Men_rows && (i + j) % 2 == 1)
                     mtx[i][j] = 2;
-                if (i > 4 && (i + j) % 2 == 1)
+                if (i >= V::Size - V::Men_rows && (i + j) % 2 == 1)
                     mtx[i][j] = 1;
             }
         }
-        add_history();
+        add_history(0);
     }
 
-    // function that re-draw all the textures
+    // hands the state over to the renderer: the position, the hops still sliding and the marks
     void rerender()
     {
-        // draw board
-        SDL_RenderClear(ren);
-        SDL_RenderCopy(ren, board, NULL, NULL);
-
-        // draw pieces
-        for (POS_T i = 0; i < 8; ++i)
-        {
-            for (POS_T j = 0; j < 8; ++j)
-            {
-                if (!mtx[i][j])
-                    continue;
-                int wpos = W * (j + 1) / 10 + W / 120;
-                int hpos = H * (i + 1) / 10 + H / 120;
-                SDL_Rect rect{ wpos, hpos, W / 12, H / 12 };
-
-                SDL_Texture* piece_texture;
-                if (mtx[i][j] == 1)
-                    piece_texture = w_piece;
-                else if (mtx[i][j] == 2)
-                    piece_texture = b_piece;
-                else if (mtx[i][j] == 3)
-                    piece_texture = w_queen;
-                else
-                    piece_texture = b_queen;
-
-                SDL_RenderCopy(ren, piece_texture, NULL, &rect);
-            }
-        }
-
-        // draw hilight
-        SDL_SetRenderDrawColor(ren, 0, 255, 0, 0);
-        const double scale = 2.5;
-        SDL_RenderSetScale(ren, scale, scale);
-        for (POS_T i = 0; i < 8; ++i)
-        {
-            for (POS_T j = 0; j < 8; ++j)
-            {
-                if (!is_highlighted_[i][j])
-                    continue;
-                SDL_Rect cell{ int(W * (j + 1) / 10 / scale), int(H * (i + 1) / 10 / scale), int(W / 10 / scale),
-                              int(H / 10 / scale) };
-                SDL_RenderDrawRect(ren, &cell);
-            }
-        }
-
-        // draw active
-        if (active_x != -1)
-        {
-            SDL_SetRenderDrawColor(ren, 255, 0, 0, 0);
-            SDL_Rect active_cell{ int(W * (active_y + 1) / 10 / scale), int(H * (active_x + 1) / 10 / scale),
-                                 int(W / 10 / scale), int(H / 10 / scale) };
-            SDL_RenderDrawRect(ren, &active_cell);
-        }
-        SDL_RenderSetScale(ren, 1, 1);
-
-        // draw arrows
-        SDL_Rect rect_left{ W / 40, H / 40, W / 15, H / 15 };
-        SDL_RenderCopy(ren, back, NULL, &rect_left);
-        SDL_Rect replay_rect{ W * 109 / 120, H / 40, W / 15, H / 15 };
-        SDL_RenderCopy(ren, replay, NULL, &replay_rect);
-
-        // draw result
-        if (game_results != -1)
-        {
-            string result_path = draw_path;
-            if (game_results == 1)
-                result_path = white_path;
-            else if (game_results == 2)
-                result_path = black_path;
-            SDL_Texture* result_texture = IMG_LoadTexture(ren, result_path.c_str());
-            if (result_texture == nullptr)
-            {
-                print_exception("IMG_LoadTexture can't load game result picture from " + result_path);
-                return;
-            }
-            SDL_Rect res_rect{ W / 5, H * 3 / 10, W * 3 / 5, H * 2 / 5 };
-            SDL_RenderCopy(ren, result_texture, NULL, &res_rect);
-            SDL_DestroyTexture(result_texture);
-        }
-
-        SDL_RenderPresent(ren);
-        // next rows for mac os
-        SDL_Delay(10);
-        SDL_Event windowEvent;
-        SDL_PollEvent(&windowEvent);
+        if (!renderer.started())
+            return;
+        Trace::Span span("rerender");
+        const auto now = chrono::steady_clock::now();
+        while (!sliding_hops.empty() &&
+               chrono::duration<double, milli>(now - sliding_hops.front().start).count() >= sliding_hops.front().ms)
+            sliding_hops.erase(sliding_hops.begin());
+        auto& frame = renderer.next_frame();
+        frame.mtx = mtx;
+        frame.highlighted = is_highlighted_;
+        frame.active_x = active_x;
+        frame.active_y = active_y;
+        frame.game_results = game_results;
+        frame.hops = sliding_hops;
+        frame.version = ++frame_version;
+        renderer.publish();
     }
 
     void print_exception(const string& text) {
@@ -334,43 +334,35 @@ private:
     }
 
 public:
+    // size of the window in the units of the mouse events
     int W = 0;
     int H = 0;
     // history of boards
     vector<vector<vector<POS_T>>> history_mtx;
+    // hashes of the boards in history_mtx, also used by the search for repetitions
+    PositionHistory history;
 
 private:
     SDL_Window* win = nullptr;
-    SDL_Renderer* ren = nullptr;
-    // textures
-    SDL_Texture* board = nullptr;
-    SDL_Texture* w_piece = nullptr;
-    SDL_Texture* b_piece = nullptr;
-    SDL_Texture* w_queen = nullptr;
-    SDL_Texture* b_queen = nullptr;
-    SDL_Texture* back = nullptr;
-    SDL_Texture* replay = nullptr;
-    // texture files names
+    BasicRenderer<V> renderer;
+    bool texture_cache = false;
+    bool render_thread = false;
+    unique_ptr<TextureLoader> loader;
     const string textures_path = project_path + "Textures/";
-    const string board_path = textures_path + "board.png";
-    const string piece_white_path = textures_path + "piece_white.png";
-    const string piece_black_path = textures_path + "piece_black.png";
-    const string queen_white_path = textures_path + "queen_white.png";
-    const string queen_black_path = textures_path + "queen_black.png";
-    const string white_path = textures_path + "white_wins.png";
-    const string black_path = textures_path + "black_wins.png";
-    const string draw_path = textures_path + "draw.png";
-    const string back_path = textures_path + "back.png";
-    const string replay_path = textures_path + "replay.png";
+    // hops whose slides are not over yet, in the order they are played
+    vector<animated_hop> sliding_hops;
+    uint64_t frame_version = 0;
     // coordinates of chosen cell
     int active_x = -1, active_y = -1;
     // game result if exist
     int game_results = -1;
     // matrix of possible moves
-    vector<vector<bool>> is_highlighted_ = vector<vector<bool>>(8, vector<bool>(8, 0));
+    vector<vector<bool>> is_highlighted_ = vector<vector<bool>>(V::Size, vector<bool>(V::Size, 0));
     // matrix of possible moves
     // 1 - white, 2 - black, 3 - white queen, 4 - black queen
-    vector<vector<POS_T>> mtx = vector<vector<POS_T>>(8, vector<POS_T>(8, 0));
+    vector<vector<POS_T>> mtx = vector<vector<POS_T>>(V::Size, vector<POS_T>(V::Size, 0));
     // series of beats for each move
     vector<int> history_beat_series;
 };
+
+typedef BasicBoard<Russian> Board;
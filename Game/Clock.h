@@ -0,0 +1,159 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+// Clock of both sides: every side starts with the base time and gets the increment after each of its
+// turns. The time of the side to move runs from start() to stop(); a side whose time runs out loses.
+class GameClock
+{
+public:
+    GameClock() = default;
+
+    // base_ms = 0 - no clock
+    GameClock(const int64_t base_ms, const int64_t increment_ms) : on(base_ms > 0), increment_ms(increment_ms)
+    {
+        left_ms[0] = left_ms[1] = base_ms;
+    }
+
+    bool enabled() const
+    {
+        return on;
+    }
+
+    void start(const bool color)
+    {
+        this->color = color;
+        started = std::chrono::steady_clock::now();
+        running = true;
+    }
+
+    // Charges the time since start() to the side to move, then adds the increment if a turn was made
+    // (not after an undo). False if the time ran out.
+    bool stop(const bool turn_made = true)
+    {
+        if (!running)
+            return true;
+        running = false;
+        left_ms[color] -= elapsed_ms();
+        if (left_ms[color] < 0)
+            return false;
+        if (turn_made)
+            left_ms[color] += increment_ms;
+        return true;
+    }
+
+    // time left of color, the running turn included
+    int64_t remaining_ms(const bool color) const
+    {
+        return left_ms[color] - (running && color == this->color ? elapsed_ms() : 0);
+    }
+
+    int64_t increment() const
+    {
+        return increment_ms;
+    }
+
+    // when the time of the side to move runs out
+    std::chrono::steady_clock::time_point deadline() const
+    {
+        if (!running)
+            return std::chrono::steady_clock::time_point::max();
+        return started + std::chrono::milliseconds(left_ms[color]);
+    }
+
+    // "m:ss" of color's time left
+    std::string to_string(const bool color) const
+    {
+        const int64_t sec = std::max<int64_t>(remaining_ms(color), 0) / 1000;
+        const std::string s = std::to_string(sec % 60);
+        return std::to_string(sec / 60) + ":" + (s.size() < 2 ? "0" : "") + s;
+    }
+
+private:
+    int64_t elapsed_ms() const
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+    }
+
+    bool on = false;
+    int64_t left_ms[2] = { 0, 0 };
+    int64_t increment_ms = 0;
+    bool color = false;
+    bool running = false;
+    std::chrono::steady_clock::time_point started;
+};
+
+// Thinking time of a bot turn under a clock. start() gives the turn a soft budget: the time left
+// shared by the turns expected until the end of the game (fewer of them with fewer pieces on the
+// board and near MaxNumTurns) plus most of the increment. The iterative deepening asks
+// next_iteration() after every finished iteration; the budget is stretched while the best turn or
+// the score keep changing and an iteration is not started if it can't finish in time. An iteration
+// that runs past the hard deadline is dropped, so the bot never flags.
+class TimeManager
+{
+public:
+    // phase - the share of the start pieces still on the board, 1 at the start
+    void start(const int64_t remaining_ms, const int64_t increment_ms, const double phase, const int turns_left)
+    {
+        started = std::chrono::steady_clock::now();
+        instability = 0;
+        iterations = 0;
+        const double turns_to_go =
+            std::max(1.0, std::min<double>(Min_turns_to_go + (Max_turns_to_go - Min_turns_to_go) * phase, turns_left));
+        const double usable = std::max<double>(0, double(remaining_ms - Overhead_ms));
+        hard_ms = usable * Max_share;
+        soft_ms = std::min(usable / turns_to_go + increment_ms * Increment_share, hard_ms / Max_stretch);
+    }
+
+    // After a finished iteration of depth with its score and whether its best turn differs from the last
+    // iteration's one: false if the search should stop with it
+    bool next_iteration(const int depth, const double score, const bool best_changed)
+    {
+        instability *= Instability_decay;
+        if (iterations++ && depth > 0)
+        {
+            instability += best_changed ? 1.0 : 0.0;
+            instability += std::min(std::abs(score - last_score) / Unstable_score, 1.0) / 2;
+        }
+        last_score = score;
+        const double budget = std::min(hard_ms, soft_ms * std::min(1 + instability, Max_stretch));
+        // the next iteration takes at least as long as all the earlier ones together
+        return elapsed_ms() * 2 < budget;
+    }
+
+    std::chrono::steady_clock::time_point hard_deadline() const
+    {
+        return started + std::chrono::microseconds(int64_t(hard_ms * 1000));
+    }
+
+    double elapsed_ms() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    }
+
+    double soft_ms = 0;
+    double hard_ms = 0;
+
+private:
+    // turns a side still has to make at the start and in a bare endgame
+    static constexpr double Max_turns_to_go = 30;
+    static constexpr double Min_turns_to_go = 10;
+    static constexpr double Increment_share = 0.75;
+    // kept for making the turn and drawing it
+    static constexpr int64_t Overhead_ms = 20;
+    // most of the time left one turn may take
+    static constexpr double Max_share = 0.4;
+    // how far instability stretches the soft budget
+    static constexpr double Max_stretch = 3.0;
+    static constexpr double Instability_decay = 0.6;
+    // a score change (log of the material ratio) counted as fully unstable, about two men in the middlegame
+    static constexpr double Unstable_score = 0.2;
+
+    std::chrono::steady_clock::time_point started;
+    double instability = 0;
+    double last_score = 0;
+    int iterations = 0;
+};
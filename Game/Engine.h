@@ -0,0 +1,305 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "../Models/Analysis.h"
+#include "Board.h"
+#include "Config.h"
+#include "Fen.h"
+#include "Logic.h"
+
+// search depth of "go" without a depth limit, the search is stopped by the other limits
+const int Max_engine_depth = Max_search_depth;
+
+// Line based text protocol for driving the engine from GUIs and tournament managers (in the spirit of UCI).
+// Commands:
+//     hello                                   -> id name Checkers, hellook
+//     isready                                 -> readyok
+//     newgame
+//     position start|fen <FEN> [moves <turn> ...]
+//     go [depth D] [movetime MS] [nodes N] [multipv K] [infinite] [ponder]
+//     stop
+//     ponderhit
+//     quit
+// While searching, the engine prints after every finished iteration
+//     info depth D multipv K score S nodes N nps X time MS pv <turn> ...
+// and then "bestmove <turn> [ponder <turn>]". Turns are written as in Fen::turn_to_string.
+// In the infinite and ponder modes bestmove waits for stop or ponderhit; after ponderhit the search
+// goes on for movetime (or stops at once if there is none).
+class Engine
+{
+public:
+    Engine(Config* config) : logic(&board, config)
+    {
+        set_position("start", {});
+    }
+
+    ~Engine()
+    {
+        stop_search();
+    }
+
+    // Reads commands from in until "quit" or the end of input
+    int run(istream& in, ostream& out)
+    {
+        this->out = &out;
+        string line;
+        while (getline(in, line))
+        {
+            stringstream ss(line);
+            string cmd;
+            ss >> cmd;
+            if (cmd.empty())
+                continue;
+            if (cmd == "quit")
+                break;
+
+            try
+            {
+                if (cmd == "hello")
+                {
+                    send("id name Checkers");
+                    send("hellook");
+                }
+                else if (cmd == "isready")
+                {
+                    send("readyok");
+                }
+                else if (cmd == "newgame")
+                {
+                    stop_search();
+                    set_position("start", {});
+                }
+                else if (cmd == "position")
+                {
+                    position(ss);
+                }
+                else if (cmd == "go")
+                {
+                    go(ss);
+                }
+                else if (cmd == "stop")
+                {
+                    stop = true;
+                    release_answer();
+                }
+                else if (cmd == "ponderhit")
+                {
+                    ponderhit();
+                }
+                else
+                {
+                    send("error unknown command " + cmd);
+                }
+            }
+            catch (const exception& e)
+            {
+                send(string("error ") + e.what());
+            }
+        }
+        stop_search();
+        return 0;
+    }
+
+private:
+    void position(stringstream& ss)
+    {
+        stop_search();
+        string word, fen;
+        while (ss >> word && word != "moves")
+        {
+            if (word != "fen")
+                fen += word;
+        }
+        vector<string> moves;
+        while (ss >> word)
+            moves.push_back(word);
+        set_position(fen, moves);
+    }
+
+    // Sets the position and fills the board history with it, so the search sees repetitions
+    void set_position(const string& fen, const vector<string>& moves)
+    {
+        vector<vector<POS_T>> new_mtx;
+        bool new_color;
+        Fen::parse(fen, new_mtx, new_color);
+
+        PositionHistory new_history;
+        new_history.push(Zobrist::hash(new_mtx, new_color), false);
+        for (const auto& move : moves)
+        {
+            bool found = false;
+            for (const auto& turn : logic.find_sequences(new_mtx, new_color))
+            {
+                if (Fen::turn_to_string(turn.to_vector()) != move)
+                    continue;
+                const bool reversible = Logic::is_reversible(new_mtx, turn);
+                new_mtx = logic.make_turn(new_mtx, turn);
+                new_color = !new_color;
+                new_history.push(Zobrist::hash(new_mtx, new_color), reversible);
+                found = true;
+                break;
+            }
+            if (!found)
+                throw runtime_error("illegal turn " + move);
+        }
+        mtx = new_mtx;
+        color = new_color;
+        board.history = new_history;
+    }
+
+    void go(stringstream& ss)
+    {
+        stop_search();
+        search_limits limits;
+        limits.depth = Max_engine_depth;
+        size_t lines = 1;
+        int movetime = 0;
+        bool infinite = false;
+        pondering = false;
+        string word;
+        while (ss >> word)
+        {
+            if (word == "depth")
+                ss >> limits.depth;
+            else if (word == "movetime")
+                ss >> movetime;
+            else if (word == "nodes")
+                ss >> limits.nodes;
+            else if (word == "multipv")
+                ss >> lines;
+            else if (word == "infinite")
+                infinite = true;
+            else if (word == "ponder")
+                pondering = true;
+            else
+                throw runtime_error("unknown go parameter " + word);
+        }
+
+        stop = false;
+        limits.stop = &stop;
+        ponder_movetime = movetime;
+        hold_answer = infinite || pondering;
+        if (movetime && !pondering)
+            start_timer(movetime);
+        searcher = thread(&Engine::search, this, limits, lines);
+    }
+
+    void ponderhit()
+    {
+        if (!pondering)
+            return;
+        pondering = false;
+        if (ponder_movetime)
+            start_timer(ponder_movetime);
+        else
+            stop = true;
+        release_answer();
+    }
+
+    void search(const search_limits limits, const size_t lines)
+    {
+        const auto start = chrono::steady_clock::now();
+        auto res = logic.analyze(mtx, color, lines, limits, [&](const analysis_result& iteration) {
+            const auto time_ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+            for (size_t i = 0; i < iteration.lines.size(); ++i)
+            {
+                const auto& line = iteration.lines[i];
+                stringstream info;
+                info << "info depth " << iteration.depth << " multipv " << i + 1 << " score " << line.score
+                    << " nodes " << iteration.nodes << " nps " << iteration.nodes * 1000 / max<long long>(time_ms, 1)
+                    << " time " << time_ms << " pv";
+                for (const auto& turn : Fen::line_to_strings(line.pv))
+                    info << " " << turn;
+                send(info.str());
+            }
+        });
+
+        // in the infinite and ponder modes the answer is given only after stop or ponderhit
+        {
+            unique_lock<mutex> lock(answer_mtx);
+            answer_cv.wait(lock, [this] { return !hold_answer || stop; });
+        }
+        if (res.lines.empty())
+        {
+            send("bestmove none");
+            return;
+        }
+        auto pv = Fen::line_to_strings(res.lines[0].pv);
+        send("bestmove " + pv[0] + (pv.size() > 1 ? " ponder " + pv[1] : ""));
+    }
+
+    // stops the running search, if any, and waits for its bestmove
+    void stop_search()
+    {
+        stop = true;
+        release_answer();
+        if (searcher.joinable())
+            searcher.join();
+        cancel_timer();
+    }
+
+    void release_answer()
+    {
+        {
+            lock_guard<mutex> lock(answer_mtx);
+            hold_answer = false;
+        }
+        answer_cv.notify_all();
+    }
+
+    // sets stop after ms milliseconds unless cancelled
+    void start_timer(const int ms)
+    {
+        cancel_timer();
+        timer_cancelled = false;
+        timer = thread([this, ms] {
+            unique_lock<mutex> lock(timer_mtx);
+            if (!timer_cv.wait_for(lock, chrono::milliseconds(ms), [this] { return timer_cancelled; }))
+                stop = true;
+        });
+    }
+
+    void cancel_timer()
+    {
+        {
+            lock_guard<mutex> lock(timer_mtx);
+            timer_cancelled = true;
+        }
+        timer_cv.notify_all();
+        if (timer.joinable())
+            timer.join();
+    }
+
+    void send(const string& text)
+    {
+        lock_guard<mutex> lock(out_mtx);
+        *out << text << endl;
+    }
+
+    Board board;
+    Logic logic;
+    vector<vector<POS_T>> mtx;
+    bool color = 0;
+    ostream* out = &cout;
+    mutex out_mtx;
+
+    thread searcher;
+    atomic<bool> stop{ false };
+    bool pondering = false;
+    int ponder_movetime = 0;
+    // bestmove of infinite and ponder searches waits for this to become false
+    bool hold_answer = false;
+    mutex answer_mtx;
+    condition_variable answer_cv;
+
+    thread timer;
+    bool timer_cancelled = false;
+    mutex timer_mtx;
+    condition_variable timer_cv;
+};
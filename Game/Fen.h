@@ -0,0 +1,153 @@
+#pragma once
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../Models/Move.h"
+#include "../Models/Variant.h"
+
+// Text form of positions and turns of the variant V in the style of PDN FEN: "W:W21,22,K30:B1-12".
+// The first letter is the side to move, then the white and black pieces, K marks a queen.
+// Dark cells are numbered from 1 row by row starting from row 0 (the black side),
+// so on 8x8 black men start on 1-12 and white men on 21-32, on 10x10 on 1-20 and 31-50.
+template <class V>
+class BasicFen
+{
+public:
+    // parses a position, "start" is the starting one; throws runtime_error on bad input
+    static void parse(const std::string& text, std::vector<std::vector<POS_T>>& mtx, bool& color)
+    {
+        mtx.assign(V::Size, std::vector<POS_T>(V::Size, 0));
+        std::string s;
+        for (char c : text)
+        {
+            if (!isspace(static_cast<unsigned char>(c)) && c != '.')
+                s += char(toupper(static_cast<unsigned char>(c)));
+        }
+        if (s == "START")
+        {
+            for (int n = 1; n <= V::Men_rows * Row_squares; ++n)
+                set(mtx, n, 2);
+            for (int n = Squares - V::Men_rows * Row_squares + 1; n <= Squares; ++n)
+                set(mtx, n, 1);
+            color = 0;
+            return;
+        }
+
+        std::stringstream ss(s);
+        std::string part;
+        if (!getline(ss, part, ':') || (part != "W" && part != "B"))
+            throw std::runtime_error("position must start with the side to move W or B");
+        color = (part == "B");
+        while (getline(ss, part, ':'))
+        {
+            if (part.empty() || (part[0] != 'W' && part[0] != 'B'))
+                throw std::runtime_error("piece list must start with W or B: " + part);
+            const POS_T man = (part[0] == 'W' ? 1 : 2);
+            std::stringstream pieces(part.substr(1));
+            std::string piece;
+            while (getline(pieces, piece, ','))
+            {
+                if (piece.empty())
+                    continue;
+                const bool is_queen = (piece[0] == 'K');
+                if (is_queen)
+                    piece = piece.substr(1);
+                const auto dash = piece.find('-');
+                const int from = number(piece.substr(0, dash));
+                const int to = (dash == std::string::npos ? from : number(piece.substr(dash + 1)));
+                for (int n = from; n <= to; ++n)
+                    set(mtx, n, POS_T(man + 2 * is_queen));
+            }
+        }
+    }
+
+    static std::string to_string(const std::vector<std::vector<POS_T>>& mtx, const bool color)
+    {
+        std::string white, black;
+        for (int n = 1; n <= Squares; ++n)
+        {
+            const POS_T piece = mtx[row(n)][col(n)];
+            if (!piece)
+                continue;
+            auto& list = (piece % 2 ? white : black);
+            list += (list.empty() ? "" : ",") + std::string(piece > 2 ? "K" : "") + std::to_string(n);
+        }
+        return std::string(color ? "B" : "W") + ":W" + white + ":B" + black;
+    }
+
+    // number of the cell, 0 if it is not a dark one
+    static int square(const POS_T x, const POS_T y)
+    {
+        return (x + y) % 2 ? x * Row_squares + y / 2 + 1 : 0;
+    }
+
+    // "22-18" for a quiet turn, "26x17x10" for a capture series
+    static std::string turn_to_string(const std::vector<move_pos>& turn)
+    {
+        std::string res = std::to_string(square(turn[0].x, turn[0].y));
+        for (const auto& hop : turn)
+            res += (hop.xb == -1 ? "-" : "x") + std::to_string(square(hop.x2, hop.y2));
+        return res;
+    }
+
+    // splits a line of hops into turns: a capture continues the turn if it starts where the previous capture ended
+    static std::vector<std::string> line_to_strings(const std::vector<move_pos>& line)
+    {
+        std::vector<std::string> res;
+        std::vector<move_pos> turn;
+        for (const auto& hop : line)
+        {
+            if (!turn.empty() && !(hop.xb != -1 && turn.back().xb != -1 && hop.x == turn.back().x2 &&
+                hop.y == turn.back().y2))
+            {
+                res.push_back(turn_to_string(turn));
+                turn.clear();
+            }
+            turn.push_back(hop);
+        }
+        if (!turn.empty())
+            res.push_back(turn_to_string(turn));
+        return res;
+    }
+
+private:
+    // dark cells in a row and on the board
+    static constexpr int Row_squares = V::Size / 2;
+    static constexpr int Squares = V::Size * V::Size / 2;
+
+    static int number(const std::string& s)
+    {
+        size_t len = 0;
+        int n = 0;
+        try
+        {
+            n = std::stoi(s, &len);
+        }
+        catch (const std::exception&)
+        {
+            len = 0;
+        }
+        if (len != s.size() || n < 1 || n > Squares)
+            throw std::runtime_error("bad square number: " + s);
+        return n;
+    }
+
+    static POS_T row(const int n)
+    {
+        return POS_T((n - 1) / Row_squares);
+    }
+
+    static POS_T col(const int n)
+    {
+        return POS_T(2 * ((n - 1) % Row_squares) + (row(n) % 2 == 0));
+    }
+
+    static void set(std::vector<std::vector<POS_T>>& mtx, const int n, const POS_T piece)
+    {
+        mtx[row(n)][col(n)] = piece;
+    }
+};
+
+typedef BasicFen<Russian> Fen;
@@ -4,17 +4,55 @@
 
 #include "../Models/Project_path.h"
 #include "Board.h"
+#include "Clock.h"
 #include "Config.h"
+#include "Fen.h"
 #include "Hand.h"
 #include "Logic.h"
 #include "../Models/Response.h"
-class Game
+
+// Game of the draughts variant V (see Variant.h) in a window
+template <class V>
+class BasicGame
 {
 public:
-    Game() : board(config("WindowSize", "Width"), config("WindowSize", "Hight")), hand(&board), logic(&board, &config)
+    BasicGame() : board(config("WindowSize", "Width"), config("WindowSize", "Height"), config("WindowSize", "TextureCache"), config("WindowSize", "RenderThread")), hand(&board), logic(&board, &config)
     {
         std::ofstream fout(project_path + "log.txt", std::ios_base::trunc);
         fout.close();
+        Trace::enable(config("Game", "Trace"));
+        Trace::name_thread("main");
+        // samples of the bot searches for Tools/tree
+        const double tree_sample = config("Bot", "TreeSample");
+        if (tree_sample > 0)
+            recorder = std::make_shared<TreeRecorder>(project_path + "tree.bin", V::Size, tree_sample,
+                uint64_t(config("Bot", "TreeMaxMB")) << 20);
+        logic.recorder = recorder;
+        // results of the bot searches, kept for the next session if SearchCachePersist is set
+        const size_t cache_mb = config("Bot", "SearchCacheMB");
+        if (cache_mb > 0)
+        {
+            cache = std::make_shared<SearchCache>(V::Size, cache_mb);
+            if (config("Bot", "SearchCachePersist"))
+                cache->load(project_path + "search_cache.bin");
+        }
+        logic.cache = cache;
+        // root results of the bot searches: undone turns and replayed openings are answered from them
+        const size_t root_results_count = config("Bot", "RootResults");
+        if (root_results_count > 0)
+            root_results = std::make_shared<RootResults>(root_results_count);
+        logic.root_results = root_results;
+    }
+
+    // the timeline of the session is written on exit when tracing is on, the search cache when it is kept.
+    // The render and texture threads record spans too, so the board is closed first.
+    ~BasicGame()
+    {
+        board.quit();
+        if (Trace::enabled())
+            Trace::save(project_path + "trace.json");
+        if (cache && config("Bot", "SearchCachePersist"))
+            cache->save(project_path + "search_cache.bin");
     }
 
     // Starts and runs the main game loop for the checkers game
@@ -26,7 +64,10 @@ public:
         // If replay requested, reset logic and settings, redraw board
         if (is_replay)
         {
-            logic = Logic(&board, &config);
+            logic = BasicLogic<V>(&board, &config);
+            logic.recorder = recorder;
+            logic.cache = cache;
+            logic.root_results = root_results;
             config.reload();
             board.redraw();
         }
@@ -37,30 +78,53 @@ public:
         }
         // Clear replay flag
         is_replay = false;
+        // The clock starts again with every game; ClockBaseMS = 0 - no clock
+        clock = GameClock(config("Game", "ClockBaseMS"), config("Game", "ClockIncrementMS"));
+        bool is_flagged = false;  // Flag if the side to move ran out of time
 
         int turn_num = -1;       // Current turn number
         bool is_quit = false;    // Flag if the player quits
+        bool is_draw = false;    // Flag if the game is drawn by repetition or king moves
         const int Max_turns = config("Game", "MaxNumTurns");  // Maximum allowed turns
 
         // Main game loop: runs until max turns reached or game ends earlier
         while (++turn_num < Max_turns)
         {
             beat_series = 0;  // Reset consecutive capture count
-            logic.find_turns(turn_num % 2);  // Find possible moves for current player (0 or 1)
 
-            // If no possible moves, game ends
-            if (logic.turns.empty())
+            // Stop early if the position repeated or only kings moved for too long
+            if (logic.is_game_drawn())
+            {
+                is_draw = true;
+                break;
+            }
+            // If the current player (0 or 1) has no possible turns, game ends
+            if (logic.find_sequences(board.get_board(), turn_num % 2).empty())
                 break;
 
             // Set AI depth (difficulty) from config based on player color
             logic.Max_depth = config("Bot", std::string((turn_num % 2) ? "Black" : "White") + std::string("BotLevel"));
 
+            if (clock.enabled())
+            {
+                board.set_title("White " + clock.to_string(0) + "  Black " + clock.to_string(1));
+                clock.start(turn_num % 2);
+            }
+
             // Check if current player is human or bot
             if (!config("Bot", std::string("Is") + std::string((turn_num % 2) ? "Black" : "White") + std::string("Bot")))
             {
                 // Human player turn - wait for player response
                 auto resp = player_turn(turn_num % 2);
 
+                // The time of a turn or an undo is charged, only a turn gets the increment
+                if (resp == Response::TIMEOUT ||
+                    ((resp == Response::OK || resp == Response::BACK) && !clock.stop(resp == Response::OK)))
+                {
+                    is_flagged = true;
+                    break;
+                }
+
                 // Handle player commands: quit, replay or undo
                 if (resp == Response::QUIT)
                 {
@@ -92,15 +156,24 @@ public:
             else
             {
                 // Bot player executes moves automatically
-                bot_turn(turn_num % 2);
+                if (!bot_turn(turn_num % 2, (Max_turns - turn_num + 1) / 2))
+                {
+                    is_flagged = true;
+                    break;
+                }
             }
         }
 
         // Log total game time
         auto end = chrono::steady_clock::now();
-        std::ofstream fout(project_path + "log.txt", std::ios_base::app);
-        fout << "Game time: " << (int)chrono::duration<double, milli>(end - start).count() << " millisec\n";
-        fout.close();
+        {
+            Trace::Span log_span("log_write");
+            std::ofstream fout(project_path + "log.txt", std::ios_base::app);
+            fout << "Game time: " << (int)chrono::duration<double, milli>(end - start).count() << " millisec\n";
+            if (is_flagged)
+                fout << ((turn_num % 2) ? "Black" : "White") << " lost on time\n";
+            fout.close();
+        }
 
         // If replay requested, restart the game recursively
         if (is_replay)
@@ -111,9 +184,9 @@ public:
         int res = 2;  // Default: game ended without winner
 
         // Determine result based on turn count and player
-        if (turn_num == Max_turns)
+        if (turn_num == Max_turns || is_draw)
         {
-            res = 0;  // Draw (max turns reached)
+            res = 0;  // Draw (max turns reached or draw rules)
         }
         else if (turn_num % 2)
         {
@@ -135,10 +208,13 @@ public:
 private:
     // Executes automated moves by the bot for the given player color
     // Uses the Logic class to calculate the best sequence of moves,
-    // enforces a delay between moves to simulate thinking,
-    // logs the time taken by the bot turn.
-    void bot_turn(const bool color)
+    // enforces a delay before the turn to simulate thinking and slides every hop on the screen
+    // for at least that long (without waiting for the slides), logs the time taken by the bot turn.
+    // Under a clock the thinking time comes from TimeManager (turns_left - turns of the bot before
+    // MaxNumTurns) and the clock stops once the turn is chosen; false if the time ran out.
+    bool bot_turn(const bool color, const int turns_left)
     {
+        Trace::Span span("bot_turn");
         // Record start time for performance measurement
         auto start = chrono::steady_clock::now();
 
@@ -147,49 +223,88 @@ private:
 
         // Create a separate thread to run SDL_Delay asynchronously
         // This allows delay to run concurrently with move calculation for smoother timing
-        std::thread th(SDL_Delay, delay_ms);
+        std::thread th([delay_ms] {
+            Trace::name_thread("bot delay");
+            Trace::Span span("bot_delay");
+            SDL_Delay(delay_ms);
+        });
 
         // Use logic engine to find the best moves to make for the bot playing 'color'
-        auto turns = logic.find_best_turns(color);
+        vector<move_pos> turns;
+        if (clock.enabled())
+        {
+            time_manager.start(clock.remaining_ms(color), clock.increment(), phase(), turns_left);
+            turns = logic.find_best_turns(color, time_manager);
+        }
+        else
+        {
+            turns = logic.find_best_turns(color);
+        }
+        const double think_ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+        const bool in_time = clock.stop();
 
         // Wait for the delay thread to finish, ensuring the minimum delay
-        th.join();
+        {
+            Trace::Span join_span("bot_delay_wait");
+            th.join();
+        }
+        if (!in_time)
+            return false;
 
-        bool is_first = true;
+        const double animation_ms = config("WindowSize", "MoveAnimationMS");
+        const double slide_ms = std::max<double>(animation_ms, delay_ms);
 
         // Execute each move in the sequence returned by the AI logic
         for (auto turn : turns)
         {
-            // Add delay between moves, except before the first move
-            if (!is_first)
-            {
-                SDL_Delay(delay_ms);
-            }
-            is_first = false;
-
             // Increment capture count if this move includes capturing a piece
             beat_series += (turn.xb != -1);
 
             // Make the move on the board, passing current beat series count
-            board.move_piece(turn, beat_series);
+            board.move_piece(turn, beat_series, slide_ms);
         }
+        if (beat_series && !turns.empty())
+            board.finish_series(turns.back().x2, turns.back().y2);
 
         // Record end time and log the total time bot took to execute moves
         auto end = chrono::steady_clock::now();
+        Trace::Span log_span("log_write");
         std::ofstream fout(project_path + "log.txt", std::ios_base::app);
         fout << "Bot turn time: " << (int)chrono::duration<double, std::milli>(end - start).count() << " millisec\n";
+        if (clock.enabled())
+            fout << "Bot clock: thought " << (int)think_ms << " of " << (int)time_manager.soft_ms << " (max "
+                 << (int)time_manager.hard_ms << ") millisec, " << clock.to_string(color) << " left\n";
+        fout << "Bot line:";
+        for (const auto& seq : logic.principal_variation())
+            fout << " " << BasicFen<V>::turn_to_string(seq.to_vector());
+        fout << "\n";
         fout.close();
+        return true;
+    }
+
+    // Share of the start pieces still on the board, for the time of the bot turns
+    double phase()
+    {
+        int pieces = 0;
+        for (const auto& row : board.get_board())
+            pieces += int(count_if(row.begin(), row.end(), [](const POS_T cell) { return cell != 0; }));
+        return double(pieces) / (V::Men_rows * V::Size);
     }
 
 
     // Handles a human player's turn, receiving input and executing moves.
+    // The player goes through one of the full turns of Logic::find_sequences hop by hop.
     Response player_turn(const bool color)
     {
+        Trace::Span span("player_turn");
+        // Every capture path separately, so any of them can be chosen
+        auto seqs = logic.find_sequences(board.get_board(), color, true);
+
         // Prepare vector with all possible cells to highlight (first moves)
         vector<pair<POS_T, POS_T>> cells;
-        for (auto turn : logic.turns)
+        for (const auto& seq : seqs)
         {
-            cells.emplace_back(turn.x, turn.y);
+            cells.emplace_back(seq.front().x, seq.front().y);
         }
         board.highlight_cells(cells);  // Highlight possible starting positions on the board
 
@@ -199,7 +314,7 @@ private:
         // Loop to get first move from player input (starting cell)
         while (true)
         {
-            auto resp = hand.get_cell();          // Get user response (selected cell)
+            auto resp = hand.get_cell(clock.deadline());  // Get user response (selected cell)
             if (std::get<0>(resp) != Response::CELL)
                 return std::get<0>(resp);          // If special response (QUIT, REPLAY), return it
 
@@ -207,14 +322,15 @@ private:
 
             bool is_correct = false;
             // Check if selected cell corresponds to a valid possible move start
-            for (auto turn : logic.turns)
+            for (const auto& seq : seqs)
             {
+                const auto& turn = seq.front();
                 if (turn.x == cell.first && turn.y == cell.second)
                 {
                     is_correct = true;
                     break;
                 }
-                if (turn == move_pos{ x, y, cell.first, cell.second })
+                if (turn.x == x && turn.y == y && turn.x2 == cell.first && turn.y2 == cell.second)
                 {
                     pos = turn;  // The player selected a valid target cell for moving from (x, y)
                     break;
@@ -247,11 +363,11 @@ private:
 
             // Highlight possible destination cells from the chosen starting cell
             vector<pair<POS_T, POS_T>> cells2;
-            for (auto turn : logic.turns)
+            for (const auto& seq : seqs)
             {
-                if (turn.x == x && turn.y == y)
+                if (seq.front().x == x && seq.front().y == y)
                 {
-                    cells2.emplace_back(turn.x2, turn.y2);
+                    cells2.emplace_back(seq.front().x2, seq.front().y2);
                 }
             }
             board.highlight_cells(cells2);
@@ -261,23 +377,31 @@ private:
         board.clear_active();
 
         // Execute the move on the board; pos.xb != -1 means a capture move
-        board.move_piece(pos, pos.xb != -1);
+        board.move_piece(pos, pos.xb != -1, config("WindowSize", "MoveAnimationMS"));
 
         if (pos.xb == -1)  // If no capture, player's turn ends
             return Response::OK;
 
-        // Continue capturing moves if possible (multi-capture turn)
+        // Continue capturing moves along the chosen series (multi-capture turn)
         beat_series = 1;
+        move_seq made(pos);  // the hops of the series made so far
         while (true)
         {
-            logic.find_turns(pos.x2, pos.y2);  // Find further possible captures from new position
-            if (!logic.have_beats)             // No more captures
+            // Keep the paths that begin with the hops made so far, every one of them from the same
+            // cell to the same cell; the start and the landing cell define a hop
+            seqs.erase(remove_if(seqs.begin(), seqs.end(), [&](const move_seq& seq) {
+                return seq.size < made.size || !equal(made.begin(), made.end(), seq.begin(),
+                    [](const move_pos& a, const move_pos& b) {
+                        return a.x == b.x && a.y == b.y && a.x2 == b.x2 && a.y2 == b.y2;
+                    });
+            }), seqs.end());
+            if (seqs.empty() || seqs.front().size == made.size)  // No more captures
                 break;
 
             vector<pair<POS_T, POS_T>> cells;
-            for (auto turn : logic.turns)
+            for (const auto& seq : seqs)
             {
-                cells.emplace_back(turn.x2, turn.y2);
+                cells.emplace_back(seq.hops[beat_series].x2, seq.hops[beat_series].y2);
             }
             board.highlight_cells(cells);      // Highlight possible destinations for next capture
             board.set_active(pos.x2, pos.y2);  // Mark current active piece location
@@ -285,15 +409,16 @@ private:
             // Loop to select next capture move from player input
             while (true)
             {
-                auto resp = hand.get_cell();
+                auto resp = hand.get_cell(clock.deadline());
                 if (std::get<0>(resp) != Response::CELL)
                     return std::get<0>(resp);
 
                 pair<POS_T, POS_T> cell{ std::get<1>(resp), std::get<2>(resp) };
 
                 bool is_correct = false;
-                for (auto turn : logic.turns)
+                for (const auto& seq : seqs)
                 {
+                    const auto& turn = seq.hops[beat_series];
                     if (turn.x2 == cell.first && turn.y2 == cell.second)
                     {
                         is_correct = true;
@@ -307,10 +432,12 @@ private:
                 board.clear_highlight();
                 board.clear_active();
                 beat_series += 1;                // Increase capture count
-                board.move_piece(pos, beat_series);
+                made.push_back(pos);
+                board.move_piece(pos, beat_series, config("WindowSize", "MoveAnimationMS"));
                 break;
             }
         }
+        board.finish_series(pos.x2, pos.y2);
 
         return Response::OK;  // Player finished move sequence
     }
@@ -319,9 +446,16 @@ private:
 
   private:
     Config config;
-    Board board;
-    Hand hand;
-    Logic logic;
+    BasicBoard<V> board;
+    BasicHand<V> hand;
+    BasicLogic<V> logic;
+    GameClock clock;
+    TimeManager time_manager;
+    shared_ptr<TreeRecorder> recorder;
+    shared_ptr<SearchCache> cache;
+    shared_ptr<RootResults> root_results;
     int beat_series;
     bool is_replay = false;
 };
+
+typedef BasicGame<Russian> Game;
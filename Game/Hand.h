@@ -6,12 +6,13 @@
 #include "Board.h"
 
 // The Hand class is responsible for handling player input (mouse, window events)
-// and interacting with the Board object.
-class Hand
+// and interacting with the Board object of the variant V.
+template <class V>
+class BasicHand
 {
 public:
     // Constructor takes a pointer to the Board to access its properties and methods
-    Hand(Board* board) : board(board)
+    BasicHand(BasicBoard<V>* board) : board(board)
     {
     }
 
@@ -21,16 +22,24 @@ public:
     //    - Response: event type (cell selected, quit, replay, undo, etc.)
     //    - POS_T xc, POS_T yc: coordinates of the selected cell on the board,
     //      or -1 if no valid cell was selected.
-    tuple<Response, POS_T, POS_T> get_cell() const
+    // Returns TIMEOUT once the deadline (the player's clock) passes.
+    tuple<Response, POS_T, POS_T> get_cell(
+        const chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max()) const
     {
         SDL_Event windowEvent;           // SDL event object to receive events (mouse, window etc.)
         Response resp = Response::OK;    // Initial response status "OK" - keep listening
         int x = -1, y = -1;              // Mouse pixel coordinates
         int xc = -1, yc = -1;            // Board cell coordinates, -1 if invalid
+        Trace::Span span("wait_input");
 
         // Infinite loop to process events until needed event is received
         while (true)
         {
+            if (chrono::steady_clock::now() >= deadline)
+            {
+                resp = Response::TIMEOUT;
+                break;
+            }
             if (SDL_PollEvent(&windowEvent))  // Poll for new SDL event in queue
             {
                 switch (windowEvent.type)     // Handle event type
@@ -45,9 +54,9 @@ public:
                     x = windowEvent.motion.x;
                     y = windowEvent.motion.y;
 
-                    // Convert pixel coordinates to board cell coordinates
-                    xc = int(y / (board->H / 10) - 1);
-                    yc = int(x / (board->W / 10) - 1);
+                    // Convert pixel coordinates to board cell coordinates (the board and a frame of one cell)
+                    xc = int(y / (board->H / (V::Size + 2)) - 1);
+                    yc = int(x / (board->W / (V::Size + 2)) - 1);
 
                     // Check if player clicked on special areas or valid cells:
                     if (xc == -1 && yc == -1 && board->history_mtx.size() > 1)
@@ -55,12 +64,12 @@ public:
                         // Click outside the board with history  undo move
                         resp = Response::BACK;
                     }
-                    else if (xc == -1 && yc == 8)
+                    else if (xc == -1 && yc == V::Size)
                     {
                         // Click on "replay" area  restart game replay
                         resp = Response::REPLAY;
                     }
-                    else if (xc >= 0 && xc < 8 && yc >= 0 && yc < 8)
+                    else if (xc >= 0 && xc < V::Size && yc >= 0 && yc < V::Size)
                     {
                         // Clicked on a valid board cell  return cell coordinates
                         resp = Response::CELL;
@@ -96,6 +105,7 @@ public:
     {
         SDL_Event windowEvent;
         Response resp = Response::OK;
+        Trace::Span span("wait_input");
 
         while (true)
         {
@@ -117,11 +127,11 @@ public:
                 {
                     int x = windowEvent.motion.x;
                     int y = windowEvent.motion.y;
-                    int xc = int(y / (board->H / 10) - 1);
-                    int yc = int(x / (board->W / 10) - 1);
+                    int xc = int(y / (board->H / (V::Size + 2)) - 1);
+                    int yc = int(x / (board->W / (V::Size + 2)) - 1);
 
                     // If clicked on the replay area
-                    if (xc == -1 && yc == 8)
+                    if (xc == -1 && yc == V::Size)
                         resp = Response::REPLAY;
                 }
                 break;
@@ -135,6 +145,7 @@ public:
     }
 
 private:
-    Board* board;  // Pointer to the Board object, used for size and history access, and board management
+    BasicBoard<V>* board;  // Pointer to the Board object, used for size and history access, and board management
 };
 
+typedef BasicHand<Russian> Hand;
@@ -0,0 +1,146 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "../Models/Move.h"
+
+// Zobrist hashing of board positions: every (cell, piece) pair and the side to move
+// get a fixed random key, the hash of a position is the xor of its keys.
+class Zobrist
+{
+public:
+    // hash of the matrix (of any variant) with color to move (0 - white, 1 - black)
+    static uint64_t hash(const std::vector<std::vector<POS_T>>& mtx, const bool color)
+    {
+        uint64_t res = color ? keys().side : 0;
+        const POS_T size = POS_T(mtx.size());
+        for (POS_T i = 0; i < size; ++i)
+        {
+            for (POS_T j = 0; j < size; ++j)
+            {
+                if (mtx[i][j])
+                    res ^= keys().cell[i][j][mtx[i][j]];
+            }
+        }
+        return res;
+    }
+
+private:
+    struct Keys
+    {
+        uint64_t cell[Max_board_size][Max_board_size][5];
+        uint64_t side;
+
+        Keys()
+        {
+            // fixed seed: hashes must be the same in every run
+            std::mt19937_64 gen(20240601);
+            for (auto& row : cell)
+                for (auto& c : row)
+                    for (auto& key : c)
+                        key = gen();
+            side = gen();
+        }
+    };
+
+    static const Keys& keys()
+    {
+        static const Keys keys;
+        return keys;
+    }
+};
+
+// Stack of position hashes, one entry per board history state. The board pushes its moves here
+// and the search pushes the positions of the current line on top of them, so repetitions are
+// found both inside the line and against the game.
+class PositionHistory
+{
+public:
+    // reversible - the position was reached by a king move without a capture
+    void push(const uint64_t hash, const bool reversible)
+    {
+        const int quiet = (reversible && !entries.empty()) ? entries.back().quiet + 1 : 0;
+        entries.push_back({ hash, quiet });
+        ++filter[hash & Filter_mask];
+    }
+
+    void pop()
+    {
+        --filter[entries.back().hash & Filter_mask];
+        entries.pop_back();
+    }
+
+    void clear()
+    {
+        entries.clear();
+        filter.fill(0);
+    }
+
+    // makes room for n more entries, so pushing them does not allocate
+    void reserve(const size_t n)
+    {
+        entries.reserve(entries.size() + n);
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+    uint64_t top() const
+    {
+        return entries.back().hash;
+    }
+
+    // number of reversible turns in a row that led to the current position
+    int quiet_turns() const
+    {
+        return entries.empty() ? 0 : entries.back().quiet;
+    }
+
+    // hash of the positions the draw rules look back at from the current one: it and the ones since the
+    // last capture or man move, in order. Searches of a position with the same such line are the same.
+    uint64_t line_hash() const
+    {
+        uint64_t res = 0;
+        const int top_index = int(entries.size()) - 1;
+        for (int i = top_index - quiet_turns(); i <= top_index; ++i)
+            res = (res ^ entries[i].hash) * 0x9e3779b97f4a7c15ULL;
+        return res;
+    }
+
+    // how many times the current position occurred, itself included. Positions before the last
+    // capture or man move can't repeat, so only that window is scanned, and only if the counting
+    // filter says there is another entry with the same low bits at all.
+    int repetitions() const
+    {
+        if (entries.empty())
+            return 0;
+        const auto& last = entries.back();
+        if (filter[last.hash & Filter_mask] < 2)
+            return 1;
+
+        int res = 1;
+        const int top_index = int(entries.size()) - 1;
+        for (int i = top_index - 2; i >= top_index - last.quiet; i -= 2)
+        {
+            res += (entries[i].hash == last.hash);
+        }
+        return res;
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t hash;
+        int quiet;
+    };
+
+    static const size_t Filter_mask = (1 << 12) - 1;
+
+    std::vector<Entry> entries;
+    // counting filter over the low bits of the hashes on the stack
+    std::array<uint16_t, Filter_mask + 1> filter{};
+};
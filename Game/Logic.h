@@ -1,197 +1,1015 @@
 ﻿#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <functional>
 #include <random>
+#include <unordered_map>
 #include <vector>
 
+#include "../Models/Analysis.h"
 #include "../Models/Move.h"
+#include "../Models/Variant.h"
 #include "Board.h"
+#include "Clock.h"
 #include "Config.h"
+#include "Fen.h"
+#include "RootResults.h"
+#include "SearchCache.h"
+#include "TreeRecorder.h"
 
 const int INF = 1e9;
+// width of the PVS null window and the widest aspiration window before falling back to a full one
+const double Null_window = 1e-6;
+const double Max_aspiration_window = 2.0;
+// time, node and stop limits are checked once per this many nodes plus one
+const size_t Limit_check_period = 1023;
+// deepest search iteration; the search stack and the principal variation table are sized by it
+const int Max_search_depth = 64;
+// plies of the search stack: the root, Max_search_depth turns and the leaves after them
+const size_t Max_ply = Max_search_depth + 2;
+// a checker jumped in the capture series being followed, while V::Remove_captured_after_series keeps it on the
+// board: it blocks the way but can't be captured again (the pieces are 1..4)
+const POS_T Captured = 5;
 
-class Logic
+// Search settings known at compile time: the Optimization level and whether the evaluation counts
+// the potential of the men (BotScoringType NumberAndPotential). The search and the evaluation are
+// templates on it and on the side to move, so a node checks neither; see BasicLogic::with_policy.
+template <int Level, bool Potential>
+struct search_policy
 {
+    // alpha-beta cutoffs: O1 and O2
+    static constexpr bool Alpha_beta = Level >= 1;
+    // killer moves, principal variation search, LMR and aspiration windows: O2
+    static constexpr bool Pvs = Level >= 2;
+    static constexpr bool Potential_eval = Potential;
+};
+
+template <class V> class BasicSolver;
+
+// Search and move generation for the draughts variant V (see Variant.h)
+template <class V>
+class BasicLogic
+{
+    // the solver searches with the move generation of the search
+    friend class BasicSolver<V>;
+
 public:
     // Constructor initializes Logic instance with pointers to the Board and Config objects.
     // Also initializes the random engine based on the "NoRandom" config flag,
     // and sets up scoring and optimization modes according to configuration.
-    Logic(Board* board, Config* config)
-        : board(board), config(config)
+    BasicLogic(BasicBoard<V>* board, Config* config)
+        : stack(Max_ply), pv_table(Max_ply * (Max_ply + 1) / 2), pv_length(Max_ply), board(board), config(config),
+          history(&board->history)
     {
         rand_eng = std::default_random_engine(
             !((*config)("Bot", "NoRandom")) ? unsigned(time(0)) : 0);
         scoring_mode = (*config)("Bot", "BotScoringType");
         optimization = (*config)("Bot", "Optimization");
+        aspiration_window = (*config)("Bot", "AspirationWindow");
+        lmr_min_depth = (*config)("Bot", "LMRMinDepth");
+        lmr_move_index = (*config)("Bot", "LMRMoveIndex");
+        lmr_reduction = (*config)("Bot", "LMRReduction");
+        draw_repetitions = (*config)("Game", "DrawRepetitions");
+        draw_quiet_turns = (*config)("Game", "DrawQuietTurns");
+        probcut_threshold = (*config)("Bot", "ProbCutThreshold");
+        if (optimization != "O0" && probcut_threshold > 0)
+            probcut = load_probcut(project_path + "probcut.json");
+        if ((*config)("Bot", "UseSolved"))
+            solved = load_solved(project_path + "solved.json");
+        // scores of another scoring or other draw rules must not be taken from the cache
+        cache_salt = uint64_t(scoring_mode == "NumberAndPotential") | uint64_t(uint32_t(draw_quiet_turns)) << 8 |
+            uint64_t(uint32_t(draw_repetitions)) << 40;
+        // a root result holds the best turn of its optimization level too
+        root_salt = cache_salt ^ std::hash<string>()(optimization);
     }
 
     // Finds the best sequence of moves for the player of specified color using minimax search.
     vector<move_pos> find_best_turns(const bool color)
     {
-        next_best_state.clear();
-        next_move.clear();
+        return find_best_turns(board->get_board(), color);
+    }
+
+    // The same for the position mtx, which doesn't have to be on the board (the board history
+    // is still used for repetitions)
+    vector<move_pos> find_best_turns(const vector<vector<POS_T>>& mtx, const bool color)
+    {
+        Trace::Span span("search");
+        nodes = 0;
+        stopped = false;
+        limits = search_limits();
+        deadline = chrono::steady_clock::time_point::max();
+        pv_length[0] = 0;
+        if (cache)
+            cache->new_search();
+
+        auto& root = stack[0];
+        root.mtx = mtx;
+        generate_sequences(root.mtx, color, false, root.turns);
+        if (root.turns.empty())
+            return {};
+        // equal turns are chosen randomly unless NoRandom is set
+        shuffle(root.turns.begin(), root.turns.end(), rand_eng);
+        history->reserve(Max_ply);
+
+        // a position searched deeply enough before is answered at once, a shallower result is the start
+        const uint64_t key = root_key(root.mtx, color);
+        const root_result known = known_result(key);
+        const int max_depth = std::min(Max_depth, Max_search_depth);
+        if (known.depth >= max_depth)
+            return root.turns[0].to_vector();
+
+        begin_recording(color);
+        root_result res;
+        if (optimization == "O2")
+        {
+            res = iterative_deepening(color, nullptr, known);
+        }
+        else
+        {
+            search_depth = max_depth;
+            const double score = search_root(color, -INF - 1, INF + 1);
+            res = { principal_variation(), score, max_depth };
+        }
+        end_recording();
+        remember(color, key, res);
+        return root.turns[0].to_vector();
+    }
+
+    // The same under a clock (time was started for this turn): iterative deepening up to Max_depth for as
+    // long as time allows, see TimeManager. A single legal turn is played without a search.
+    vector<move_pos> find_best_turns(const bool color, TimeManager& time)
+    {
+        Trace::Span span("search");
+        nodes = 0;
+        stopped = false;
+        limits = search_limits();
+        pv_length[0] = 0;
+        if (cache)
+            cache->new_search();
+
+        auto& root = stack[0];
+        root.mtx = board->get_board();
+        generate_sequences(root.mtx, color, false, root.turns);
+        if (root.turns.size <= 1)
+            return root.turns.empty() ? vector<move_pos>() : root.turns[0].to_vector();
+        shuffle(root.turns.begin(), root.turns.end(), rand_eng);
+        history->reserve(Max_ply);
 
-        // Запускаем поиск с начальными параметрами. Координаты -1, -1 означают поиск со всей доски.
-        find_first_best_turn(board->get_board(), color, -1, -1, 0);
+        const uint64_t key = root_key(root.mtx, color);
+        const root_result known = known_result(key);
+        if (known.depth >= std::min(Max_depth, Max_search_depth))
+            return root.turns[0].to_vector();
+
+        deadline = time.hard_deadline();
+        begin_recording(color);
+        const root_result res = iterative_deepening(color, &time, known);
+        end_recording();
+        deadline = chrono::steady_clock::time_point::max();
+        remember(color, key, res);
+        return root.turns[0].to_vector();
+    }
 
-        int cur_state = 0;
-        vector<move_pos> res;
-        // Собираем цепочку ходов из next_move и next_best_state
-        do
+    // ProbCut pairs of the file written by Tools/probcut for boards of V::Size; none if there is no such file
+    static vector<probcut_pair> load_probcut(const string& path)
+    {
+        vector<probcut_pair> res;
+        ifstream fin(path);
+        if (!fin)
+            return res;
+        const json data = json::parse(fin, nullptr, false);
+        if (data.is_discarded() || data.value("board_size", 0) != V::Size || !data.contains("pairs"))
+            return res;
+        for (const auto& p : data["pairs"])
         {
-            res.push_back(next_move[cur_state]);
-            cur_state = next_best_state[cur_state];
-        } while (cur_state != -1 && next_move[cur_state].x != -1);
+            const probcut_pair pair{ p["deep"].get<size_t>(), p["shallow"].get<size_t>(), p["a"].get<double>(),
+                p["b"].get<double>(), p["sigma"].get<double>() };
+            if (pair.shallow < pair.deep && pair.a > 0 && pair.sigma > 0)
+                res.push_back(pair);
+        }
+        sort(res.begin(), res.end(), [](const probcut_pair& a, const probcut_pair& b) {
+            return a.deep != b.deep ? a.deep < b.deep : a.shallow < b.shallow;
+        });
         return res;
     }
 
-private:
-    // Первичная часть поиска с учётом обязательных ходов со взятием
-    double find_first_best_turn(vector<vector<POS_T>> mtx, const bool color, const POS_T x, const POS_T y,
-        size_t state, double alpha = -1)
+    // Positions of the file written by Tools/solve for boards of V::Size by their Zobrist hash; none if there
+    // is no such file. Unknown results are left out.
+    static unordered_map<uint64_t, solved_position> load_solved(const string& path)
     {
-        next_best_state.push_back(-1);
-        next_move.emplace_back(-1, -1, -1, -1);
-        double best_score = -1;
+        unordered_map<uint64_t, solved_position> res;
+        ifstream fin(path);
+        if (!fin)
+            return res;
+        const json data = json::parse(fin, nullptr, false);
+        if (data.is_discarded() || data.value("board_size", 0) != V::Size || !data.contains("positions"))
+            return res;
+        for (const auto& p : data["positions"])
+        {
+            const string value = p.value("result", "");
+            if (value != "win" && value != "draw" && value != "loss")
+                continue;
+            vector<vector<POS_T>> mtx;
+            bool color;
+            BasicFen<V>::parse(p["fen"].get<string>(), mtx, color);
+            res[Zobrist::hash(mtx, color)] = { int8_t(value == "win" ? 1 : value == "loss" ? -1 : 0), p.value("quiet", 0) };
+        }
+        return res;
+    }
+
+    // Restarts the choice between equal turns from seed, so that searches can be repeated exactly
+    void seed(const unsigned seed)
+    {
+        rand_eng.seed(seed);
+    }
 
-        if (state != 0)
-            find_turns(x, y, mtx);
+    // Principal variation of the last find_best_turns: the chosen turn and the expected replies
+    vector<move_seq> principal_variation() const
+    {
+        return vector<move_seq>(pv_table.begin(), pv_table.begin() + pv_length[0]);
+    }
 
-        auto turns_now = turns;
-        bool have_beats_now = have_beats;
+    // Multi-PV analysis of the position mtx with color to move: the best `lines` turns with scores
+    // and principal variations. Iterative deepening runs until one of the limits is reached and
+    // the last finished iteration is returned; on_iteration is called after each of them.
+    // If the history already ends with this position (a game in progress), it is used for repetitions.
+    analysis_result analyze(const vector<vector<POS_T>>& mtx, const bool color, size_t lines,
+        const search_limits& search_limits, const function<void(const analysis_result&)>& on_iteration = nullptr)
+    {
+        Trace::Span span("analyze");
+        lines = std::max<size_t>(lines, 1);
+        const auto start = chrono::steady_clock::now();
+        analysis_result res;
+        nodes = 0;
+        stopped = false;
+        // the first iteration always finishes, so there is an answer whatever the limits are
+        limits = search_limits;
+        limits.nodes = 0;
+        limits.stop = nullptr;
+        deadline = chrono::steady_clock::time_point::max();
+        killers.fill(move_pos());
+        if (cache)
+            cache->new_search();
+        const uint64_t hash = Zobrist::hash(mtx, color);
+        const bool push_root = (!history->size() || history->top() != hash);
+        if (push_root)
+            history->push(hash, false);
+        history->reserve(Max_ply);
 
-        if (!have_beats_now && state != 0)
+        auto& root = stack[0];
+        root.mtx = mtx;
+        generate_sequences(root.mtx, color, false, root.turns);
+        vector<analysis_line> candidates;
+        for (const auto& seq : root.turns)
         {
-            return find_best_turns_rec(mtx, 1 - color, 0, alpha);
+            candidates.push_back({ seq.to_vector(), 0, {} });
         }
 
-        for (auto turn : turns_now)
+        const int max_depth = std::min(search_limits.depth, Max_search_depth);
+        for (int depth = 0; depth <= max_depth && !candidates.empty(); ++depth)
         {
-            size_t next_state = next_move.size();
-            double score;
+            search_depth = depth;
+            // exact scores found so far; a line only has to be proven worse than the lines-th of them
+            vector<double> top;
+            vector<char> exact(candidates.size());
+            for (size_t i = 0; i < candidates.size() && !stopped; ++i)
+            {
+                auto& line = candidates[i];
+                const double bound = (top.size() >= lines ? top[lines - 1] : -INF - 1);
+                move_seq seq;
+                for (const auto& hop : line.turn)
+                    seq.push_back(hop);
 
-            if (have_beats_now)
+                play(0, seq);
+                const bool reversible = is_reversible(root.mtx, seq);
+                // 0.0 - score: a draw is 0 for both sides, not the -0 of a negated 0
+                line.score = 0.0 - with_policy(!color, [&](auto policy, auto side) {
+                    return search_position<decltype(policy), decltype(side)::value>(1, 0, -INF - 1, -bound, reversible);
+                });
+                line.pv = line.turn;
+                for (size_t j = 0; j < pv_length[1]; ++j)
+                    line.pv.insert(line.pv.end(), pv_row(1)[j].begin(), pv_row(1)[j].end());
+                exact[i] = (line.score > bound);
+                if (exact[i])
+                {
+                    top.insert(upper_bound(top.begin(), top.end(), line.score, greater<double>()), line.score);
+                }
+            }
+            if (stopped)
+                break;
+
+            // best first, an exact score before a bound equal to it
+            vector<size_t> order(candidates.size());
+            for (size_t i = 0; i < order.size(); ++i)
+                order[i] = i;
+            stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) {
+                if (candidates[a].score != candidates[b].score)
+                    return candidates[a].score > candidates[b].score;
+                return exact[a] > exact[b];
+            });
+            vector<analysis_line> sorted;
+            for (auto i : order)
+                sorted.push_back(candidates[i]);
+            candidates = sorted;
+
+            res.lines.assign(candidates.begin(), candidates.begin() + std::min(lines, candidates.size()));
+            res.depth = depth;
+            res.nodes = nodes;
+            if (on_iteration)
+                on_iteration(res);
+
+            limits = search_limits;
+            if (limits.time_ms)
+                deadline = start + chrono::milliseconds(limits.time_ms);
+            if (limit_reached())
+                break;
+        }
+
+        if (push_root)
+            history->pop();
+        res.nodes = nodes;
+        return res;
+    }
+
+private:
+    // One ply of the search stack: the position and its turns. The stack is allocated with
+    // the Logic, so the search itself does not allocate.
+    struct search_ply
+    {
+        vector<vector<POS_T>> mtx = vector<vector<POS_T>>(V::Size, vector<POS_T>(V::Size));
+        move_list turns;
+        // what the last search of the position did, for the tree recorder: turns searched, TreeRecorder::Flags
+        size_t searched = 0;
+        uint8_t flags = 0;
+    };
+
+    // O2: iterative deepening, each iteration searched inside an aspiration window
+    // around the previous iteration's score and widened on fail low / fail high.
+    // Under a clock (time) every optimization level deepens, O2 with the aspiration windows; time decides
+    // after each iteration whether to go on, and an iteration cut by the deadline is dropped.
+    // A known result of the root (last, see known_result) counts as its last finished iteration: deepening
+    // goes on from the next depth. Returns the last finished iteration, of depth -1 if there is none.
+    root_result iterative_deepening(const bool color, TimeManager* time = nullptr, root_result last = {})
+    {
+        double score = last.score;
+        killers.fill(move_pos());
+        const int max_depth = std::min(Max_depth, Max_search_depth);
+        auto& root = stack[0];
+        for (int depth = last.depth + 1; depth <= max_depth; ++depth)
+        {
+            Trace::Span span("iteration");
+            search_depth = depth;
+            double delta = aspiration_window;
+            bool full_window = (last.depth < 0 || optimization != "O2" || std::abs(score) >= INF);
+            double alpha = full_window ? -INF - 1 : score - delta;
+            double beta = full_window ? INF + 1 : score + delta;
+            while (true)
+            {
+                score = search_root(color, alpha, beta);
+                if (stopped || (score > alpha && score < beta))
+                    break;
+                delta *= 2;
+                if (score <= alpha)
+                    alpha = (delta > Max_aspiration_window ? -INF - 1 : score - delta);
+                else
+                    beta = (delta > Max_aspiration_window ? INF + 1 : score + delta);
+            }
+            if (!time)
             {
-                // Рекурсивный вызов с тем же цветом при взятии
-                score = find_first_best_turn(make_turn(mtx, turn), color, turn.x2, turn.y2, next_state, best_score);
+                last = { principal_variation(), score, depth };
+                continue;
             }
-            else
+            if (stopped && last.depth >= 0)
             {
-                // Ход без взятия — рекурсивный вызов с другим цветом и глубиной 0
-                score = find_best_turns_rec(make_turn(mtx, turn), 1 - color, 0, best_score);
+                // the last finished iteration decides
+                auto it = find_if(root.turns.begin(), root.turns.end(), [&](const move_seq& seq) {
+                    return same_result(root.mtx, seq, last.pv[0]);
+                });
+                if (it != root.turns.end())
+                    rotate(root.turns.begin(), it, it + 1);
+                copy(last.pv.begin(), last.pv.end(), pv_row(0));
+                pv_length[0] = last.pv.size();
+                break;
             }
+            const bool best_changed = (last.depth >= 0 && !same_result(root.mtx, root.turns[0], last.pv[0]));
+            if (!stopped)
+                last = { principal_variation(), score, depth };
+            if (!time->next_iteration(depth, score, best_changed))
+                break;
+        }
+        return last;
+    }
+
+    // Key of root_results for the position mtx with color to move: the position, the line of the game
+    // the draw rules look back at (the history must end with the position) and the settings
+    uint64_t root_key(const vector<vector<POS_T>>& mtx, const bool color) const
+    {
+        return SearchCache::key(Zobrist::hash(mtx, color) ^ history->line_hash(), history->quiet_turns(), root_salt);
+    }
+
+    // The result of root_results for the root (stack[0]) of key: its turn is put in front of the root turns
+    // and its line into the PV. Of depth -1 if there is none or its turn is not one of the root turns.
+    root_result known_result(const uint64_t key)
+    {
+        const root_result* res = root_results ? root_results->find(key) : nullptr;
+        if (!res || res->pv.empty())
+            return {};
+        auto& root = stack[0];
+        auto it = find_if(root.turns.begin(), root.turns.end(), [&](const move_seq& seq) {
+            return same_result(root.mtx, seq, res->pv[0]);
+        });
+        if (it == root.turns.end())
+            return {};
+        rotate(root.turns.begin(), it, it + 1);
+        copy(res->pv.begin(), res->pv.end(), pv_row(0));
+        pv_length[0] = res->pv.size();
+        return *res;
+    }
+
+    // Keeps the finished search res of the root (stack[0]) with color to move in root_results. The rest
+    // of its line is kept for the position after the turn and the expected reply as well: it is what a
+    // search of that position with two plies less finds, so the next turn starts from there if the
+    // reply is played.
+    void remember(const bool color, const uint64_t key, const root_result& res)
+    {
+        if (!root_results || res.depth < 0 || res.pv.empty())
+            return;
+        root_results->put(key, res);
+        if (res.depth < 2 || res.pv.size() < 3)
+            return;
+        play(0, res.pv[0]);
+        play(1, res.pv[1]);
+        history->push(Zobrist::hash(stack[1].mtx, !color), is_reversible(stack[0].mtx, res.pv[0]));
+        history->push(Zobrist::hash(stack[2].mtx, color), is_reversible(stack[1].mtx, res.pv[1]));
+        const uint64_t next = root_key(stack[2].mtx, color);
+        history->pop();
+        history->pop();
+        root_results->put(next, { vector<move_seq>(res.pv.begin() + 2, res.pv.end()), res.score, res.depth - 2 });
+    }
+
+    // Searches the root turns (stack[0]) in their order and returns the best score from color's point
+    // of view. The best turn is moved to the front, so the next O2 iteration tries it first.
+    double search_root(const bool color, const double alpha, const double beta)
+    {
+        return with_policy(color, [&](auto policy, auto side) {
+            return search_root<decltype(policy), decltype(side)::value>(alpha, beta);
+        });
+    }
 
+    // Calls f(P(), integral_constant<bool, color>()) with the search_policy P of the Optimization and
+    // BotScoringType settings: the search below is picked here once and does not look at them again.
+    // Any level but O0 and O2 searches like O1.
+    template <class F> double with_policy(const bool color, F&& f) const
+    {
+        const bool potential = (scoring_mode == "NumberAndPotential");
+        if (optimization == "O2")
+            return potential ? with_color<search_policy<2, true>>(color, f) : with_color<search_policy<2, false>>(color, f);
+        if (optimization == "O0")
+            return potential ? with_color<search_policy<0, true>>(color, f) : with_color<search_policy<0, false>>(color, f);
+        return potential ? with_color<search_policy<1, true>>(color, f) : with_color<search_policy<1, false>>(color, f);
+    }
+
+    template <class P, class F> static double with_color(const bool color, F& f)
+    {
+        return color ? f(P(), std::true_type()) : f(P(), std::false_type());
+    }
+
+    template <class P, bool Color> double search_root(double alpha, const double beta)
+    {
+        auto& root = stack[0];
+        pv_length[0] = 0;
+        double best_score = -INF - 1;
+        size_t best = 0;
+        size_t searched = 0;
+        if (recording)
+            recording->enter(0, search_depth + 1, alpha, beta);
+        for (size_t i = 0; i < root.turns.size; ++i)
+        {
+            const auto& seq = root.turns[i];
+            play(0, seq);
+            if (recording)
+                record_move(1, seq);
+            searched = i + 1;
+            const double score = search_child<P, !Color>(1, 0, alpha, beta, i, 0, is_reversible(root.mtx, seq));
             if (score > best_score)
             {
                 best_score = score;
-                next_best_state[state] = (have_beats_now ? int(next_state) : -1);
-                next_move[state] = turn;
+                best = i;
+                update_pv(0, seq);
             }
+            alpha = std::max(alpha, score);
+            if (alpha >= beta)
+                break;
         }
+        if (recording)
+            recording->exit(0, root.turns.size, searched,
+                (alpha >= beta ? TreeRecorder::Cutoff : 0) | (stopped ? TreeRecorder::Stopped : 0), best_score);
+        rotate(root.turns.begin(), root.turns.begin() + best, root.turns.begin() + best + 1);
         return best_score;
     }
 
-    // Рекурсивный minimax с alpha-beta
-    double find_best_turns_rec(vector<vector<POS_T>> mtx, const bool color, const size_t depth,
-        double alpha = -1, double beta = INF + 1, const POS_T x = -1, const POS_T y = -1)
+    // Рекурсивный negamax с alpha-beta: score is from the point of view of color, the side to move.
+    // The position is stack[ply]; every node is a full turn, a capture series is one move.
+    // The best line from here is left in the PV table row of ply.
+    template <class P, bool Color>
+    double find_best_turns_rec(const size_t ply, const size_t depth, double alpha, const double beta)
     {
-        if (depth == Max_depth)
+        if (!recording)
+            return search_node<P, Color>(ply, depth, alpha, beta);
+        recording->enter(ply, depth < search_depth ? search_depth - depth : 0, alpha, beta);
+        const double score = search_node<P, Color>(ply, depth, alpha, beta);
+        const auto& node = stack[ply];
+        const bool searched =
+            !(node.flags & (TreeRecorder::Leaf | TreeRecorder::Probcut | TreeRecorder::Cached | TreeRecorder::Stopped));
+        recording->exit(ply, searched ? node.turns.size : 0, searched ? node.searched : 0,
+            node.flags | (stopped ? TreeRecorder::Stopped : 0), score);
+        return score;
+    }
+
+    template <class P, bool Color>
+    double search_node(const size_t ply, const size_t depth, double alpha, const double beta)
+    {
+        ++nodes;
+        pv_length[ply] = 0;
+        auto& node = stack[ply];
+        if (stopped || ((nodes & Limit_check_period) == 0 && limit_reached()))
+        {
+            node.flags = TreeRecorder::Stopped;
+            return 0;
+        }
+        if (depth >= search_depth)
         {
-            return calc_score(mtx, (depth % 2 == color));
+            node.flags = TreeRecorder::Leaf;
+            return to_negamax(evaluate<P::Potential_eval, Color>(node.mtx));
         }
 
-        if (x != -1)
+        // the cache answers if the position was searched as deep before and its score decides here
+        const size_t remaining = search_depth - depth;
+        const size_t draws_before = repetition_draws;
+        uint64_t key = 0;
+        const cache_entry* entry = nullptr;
+        if (P::Alpha_beta && cache)
         {
-            find_turns(x, y, mtx);
+            key = SearchCache::key(history->top(), history->quiet_turns(), cache_salt);
+            entry = cache->probe(key);
+            if (entry && entry->depth >= remaining && cached_cut<Color>(ply, *entry, alpha, beta))
+            {
+                node.flags = TreeRecorder::Cached;
+                return entry->score;
+            }
         }
-        else
+
+        double probcut_score;
+        if (P::Alpha_beta && !probcut.empty() && probcut_cut<P, Color>(ply, depth, beta, probcut_score))
         {
-            find_turns(color, mtx);
+            node.flags = TreeRecorder::Probcut;
+            return probcut_score;
         }
 
-        auto turns_now = turns;
-        bool have_beats_now = have_beats;
+        auto& seqs = node.turns;
+        generate_sequences<Color>(node.mtx, false, seqs);
+        node.searched = 0;
+        node.flags = 0;
+        if (seqs.empty())
+            return -INF;
+        shuffle(seqs.begin(), seqs.end(), rand_eng);  // the generator order would favour the top rows
 
-        if (!have_beats_now && x != -1)
+        // the best turn of the last search of the position goes first
+        size_t ordered = 0;
+        if (entry && entry->from != SearchCache::No_cell)
         {
-            return find_best_turns_rec(mtx, 1 - color, depth + 1, alpha, beta);
+            auto it = find_if(seqs.begin(), seqs.end(), [&](const move_seq& seq) { return is_cached_turn(seq, *entry); });
+            if (it != seqs.end())
+            {
+                iter_swap(seqs.begin(), it);
+                ordered = 1;
+            }
         }
 
-        if (turns.empty())
-            return (depth % 2 ? 0 : INF);
+        // O2: the quiet move that caused the last cutoff on this depth (killer move) goes next
+        if (P::Pvs && !seqs[0].is_capture())
+        {
+            auto it = find_if(seqs.begin() + ordered, seqs.end(), [&](const move_seq& seq) {
+                return same_turn(seq.front(), killers[depth]);
+            });
+            if (it != seqs.end())
+                iter_swap(seqs.begin() + ordered, it);
+        }
 
-        double min_score = INF + 1;
-        double max_score = -1;
+        const double window_alpha = alpha;
+        double best_score = -INF - 1;
+        size_t best = 0;
 
-        for (auto turn : turns_now)
+        for (size_t i = 0; i < seqs.size; ++i)
         {
-            double score = 0.0;
+            const auto& seq = seqs[i];
+            play(ply, seq);
+            if (recording)
+                record_move(ply + 1, seq);
+            node.searched = i + 1;
+            const double score = search_child<P, !Color>(ply + 1, depth + 1, alpha, beta, i,
+                reduction<P>(node.mtx, seq, depth, i), is_reversible(node.mtx, seq));
 
-            if (!have_beats_now && x == -1)
+            if (score > best_score)
             {
-                score = find_best_turns_rec(make_turn(mtx, turn), 1 - color, depth + 1, alpha, beta);
+                best_score = score;
+                best = i;
+                update_pv(ply, seq);
             }
-            else
+
+            // Alpha-beta отсечение
+            alpha = std::max(alpha, score);
+            if (P::Alpha_beta && alpha >= beta)
             {
-                score = find_best_turns_rec(make_turn(mtx, turn), color, depth, alpha, beta, turn.x2, turn.y2);
+                if (P::Pvs && !seq.is_capture())
+                    killers[depth] = seq.front();
+                node.flags = TreeRecorder::Cutoff;
+                break;
             }
+        }
 
-            min_score = std::min(min_score, score);
-            max_score = std::max(max_score, score);
+        if (P::Alpha_beta && cache && !stopped && repetition_draws == draws_before)
+        {
+            const auto bound = best_score >= beta ? SearchCache::Lower
+                : best_score <= window_alpha      ? SearchCache::Upper
+                                                  : SearchCache::Exact;
+            const bool has_turn = (bound != SearchCache::Upper);
+            cache->store(key, best_score, int(remaining), bound,
+                has_turn ? uint8_t(seqs[best].front().x * V::Size + seqs[best].front().y) : SearchCache::No_cell,
+                has_turn ? uint8_t(seqs[best].back().x2 * V::Size + seqs[best].back().y2) : SearchCache::No_cell);
+        }
+        return best_score;
+    }
 
-            // Alpha-beta отсечение
-            if (depth % 2)
-                alpha = std::max(alpha, max_score);
-            else
-                beta = std::min(beta, min_score);
+    // Whether the cached result of stack[ply] decides the node: a bound beyond the window, or an exact
+    // score inside it, whose principal variation is then rebuilt from the cache
+    template <bool Color>
+    bool cached_cut(const size_t ply, const cache_entry& entry, const double alpha, const double beta)
+    {
+        if (entry.bound != SearchCache::Upper && entry.score >= beta)
+            return true;
+        if (entry.bound != SearchCache::Lower && entry.score <= alpha)
+            return true;
+        if (entry.bound != SearchCache::Exact)
+            return false;
+        cached_pv(ply, Color, entry.depth);
+        return true;
+    }
 
-            if (optimization != "O0" && alpha >= beta)
-                return (depth % 2 ? max_score + 1 : min_score - 1);
+    // Follows the best turns of the cache from stack[ply], with color to move, for at most `plies` turns
+    // into the PV row of ply; the deeper plies of the stack are free for it
+    void cached_pv(const size_t ply, bool color, const size_t plies)
+    {
+        auto row = pv_row(ply);
+        size_t length = 0;
+        uint64_t hash = history->top();
+        int quiet = history->quiet_turns();
+        for (size_t p = ply; length < plies && p + 1 < Max_ply; ++p)
+        {
+            const cache_entry* entry = cache->probe(SearchCache::key(hash, quiet, cache_salt));
+            if (!entry || entry->from == SearchCache::No_cell)
+                break;
+            auto& turns = stack[p].turns;
+            generate_sequences(stack[p].mtx, color, false, turns);
+            auto it = find_if(turns.begin(), turns.end(), [&](const move_seq& seq) { return is_cached_turn(seq, *entry); });
+            if (it == turns.end())
+                break;
+            row[length++] = *it;
+            play(p, *it);
+            quiet = is_reversible(stack[p].mtx, *it) ? quiet + 1 : 0;
+            color = !color;
+            hash = Zobrist::hash(stack[p + 1].mtx, color);
         }
+        pv_length[ply] = length;
+    }
 
-        return (depth % 2 ? max_score : min_score);
+    static bool is_cached_turn(const move_seq& seq, const cache_entry& entry)
+    {
+        return seq.front().x * V::Size + seq.front().y == entry.from && seq.back().x2 * V::Size + seq.back().y2 == entry.to;
     }
 
-    // Прочие функции и переменные остаются без изменений
+    // ProbCut: the score of a search with `deep` plies left is close to a * s + b, where s is the score
+    // of a search with `shallow` plies left (Tools/probcut fits the pairs by self-play). Before searching
+    // stack[ply] deeply, a null window search with fewer plies checks whether the prediction is above beta
+    // by more than probcut_threshold standard deviations of its error; if so, the node fails high with beta.
+    // Several pairs for one depth are tried cheapest first (multi-ProbCut). The same check below alpha
+    // cost more nodes than it saved, so a node is only cut on the beta side.
+    template <class P, bool Color>
+    bool probcut_cut(const size_t ply, const size_t depth, const double beta, double& score)
+    {
+        if (beta >= INF)
+            return false;
+        const size_t remaining = search_depth - depth;
+        for (const auto& pair : probcut)
+        {
+            if (pair.deep != remaining)
+                continue;
+            const double bound = (beta + probcut_threshold * pair.sigma - pair.b) / pair.a;
+            if (bound >= INF)
+                continue;
+            const double shallow_score =
+                find_best_turns_rec<P, Color>(ply, search_depth - pair.shallow, bound - Null_window, bound);
+            if (shallow_score >= bound && !stopped)
+            {
+                score = beta;
+                return true;
+            }
+        }
+        pv_length[ply] = 0;
+        return false;
+    }
 
-    // Прочие методы...
+    // The recorder records this search if it samples it
+    void begin_recording(const bool color)
+    {
+        recording = (recorder && recorder->begin_search(color, Max_depth)) ? recorder.get() : nullptr;
+    }
 
-    // Applies the specified move 'turn' to the given board matrix 'mtx'.
-    vector<vector<POS_T>> make_turn(vector<vector<POS_T>> mtx, move_pos turn) const
+    void end_recording()
     {
-        if (turn.xb != -1)
-            mtx[turn.xb][turn.yb] = 0;
+        if (recording)
+            recording->end_search(nodes);
+        recording = nullptr;
+    }
 
-        if ((mtx[turn.x][turn.y] == 1 && turn.x2 == 0) || (mtx[turn.x][turn.y] == 2 && turn.x2 == 7))
-            mtx[turn.x][turn.y] += 2;
+    // seq leads to the position of ply: its first and last cells and the number of hops of a capture
+    void record_move(const size_t ply, const move_seq& seq)
+    {
+        recording->set_move(ply, uint8_t(seq.front().x * V::Size + seq.front().y),
+            uint8_t(seq.back().x2 * V::Size + seq.back().y2), uint8_t(seq.is_capture() ? seq.size : 0));
+    }
 
-        mtx[turn.x2][turn.y2] = mtx[turn.x][turn.y];
-        mtx[turn.x][turn.y] = 0;
+    // Searches the position stack[ply] reached by a turn, where the opponent (color) is to move, and
+    // returns the score from the mover's point of view. O2 uses principal variation search: only the
+    // first turn gets the full window, later ones a null window (reduced by LMR when late enough)
+    // and are re-searched only if they beat alpha.
+    template <class P, bool Color>
+    double search_child(const size_t ply, const size_t depth, const double alpha, const double beta,
+        const size_t move_index, const size_t reduction, const bool reversible)
+    {
+        if (!P::Pvs || move_index == 0)
+            return -search_position<P, Color>(ply, depth, -beta, -alpha, reversible);
 
-        return mtx;
+        double score = -search_position<P, Color>(ply, depth + reduction, -alpha - Null_window, -alpha, reversible);
+        if (score > alpha && reduction)
+            score = -search_position<P, Color>(ply, depth, -alpha - Null_window, -alpha, reversible);
+        if (score > alpha && score < beta)
+            score = -search_position<P, Color>(ply, depth, -beta, -alpha, reversible);
+        return score;
+    }
+
+    // Searches the position stack[ply] after a finished turn with color to move. The position stays on
+    // the history stack meanwhile; a repetition inside the line or too many king moves is a draw.
+    template <class P, bool Color>
+    double search_position(const size_t ply, const size_t depth, const double alpha, const double beta,
+        const bool reversible)
+    {
+        pv_length[ply] = 0;
+        const uint64_t hash = Zobrist::hash(stack[ply].mtx, Color);
+        history->push(hash, reversible);
+        double score = 0;
+        if (is_draw(2))
+        {
+            // the quiet turns are part of the cache key, the earlier positions of the line are not
+            if (!(draw_quiet_turns && history->quiet_turns() >= draw_quiet_turns))
+                ++repetition_draws;
+        }
+        else if (!(!solved.empty() && solved_score(hash, score)))
+            score = find_best_turns_rec<P, Color>(ply, depth, alpha, beta);
+        history->pop();
+        return score;
+    }
+
+    // Exact score of the position on top of the history if it is solved, see solved_position
+    bool solved_score(const uint64_t hash, double& score) const
+    {
+        const auto it = solved.find(hash);
+        if (it == solved.end())
+            return false;
+        const int quiet = history->quiet_turns();
+        if (it->second.value ? quiet > it->second.quiet_turns : quiet != it->second.quiet_turns)
+            return false;
+        score = it->second.value * double(INF);
+        return true;
+    }
+
+    // Puts the position after seq, made in stack[ply], on the next ply of the stack
+    void play(const size_t ply, const move_seq& seq)
+    {
+        auto& next = stack[ply + 1].mtx;
+        next = stack[ply].mtx;
+        apply_turn(next, seq);
+    }
+
+    // Row of the triangular PV table for ply: the best line found from stack[ply],
+    // at most Max_ply - ply turns long
+    move_seq* pv_row(const size_t ply)
+    {
+        return pv_table.data() + ply * Max_ply - ply * (ply - 1) / 2;
+    }
+
+    const move_seq* pv_row(const size_t ply) const
+    {
+        return pv_table.data() + ply * Max_ply - ply * (ply - 1) / 2;
+    }
+
+    // seq is the new best turn in stack[ply], its line continues with the one of the next ply
+    void update_pv(const size_t ply, const move_seq& seq)
+    {
+        auto row = pv_row(ply);
+        row[0] = seq;
+        copy(pv_row(ply + 1), pv_row(ply + 1) + pv_length[ply + 1], row + 1);
+        pv_length[ply] = pv_length[ply + 1] + 1;
+    }
+
+    // Checks the limits of the analysis; once one is reached, the search unwinds and its results are dropped
+    bool limit_reached()
+    {
+        stopped = (limits.stop && *limits.stop) || (limits.nodes && nodes >= limits.nodes) ||
+            chrono::steady_clock::now() >= deadline;
+        return stopped;
+    }
+
+    // Draw rules: the current position occurred `repetitions` times,
+    // or DrawQuietTurns turns were made without captures and man moves
+    bool is_draw(const int repetitions) const
+    {
+        return (draw_repetitions && history->repetitions() >= std::min(repetitions, draw_repetitions)) ||
+            (draw_quiet_turns && history->quiet_turns() >= draw_quiet_turns);
+    }
+
+    // Late move reduction for the turn number move_index: late quiet moves far enough from the
+    // leaves are searched shallower first; captures and promotions are never reduced.
+    template <class P>
+    size_t reduction(const vector<vector<POS_T>>& mtx, const move_seq& seq, const size_t depth,
+        const size_t move_index) const
+    {
+        if (!P::Pvs || move_index < lmr_move_index || depth + lmr_min_depth > search_depth)
+            return 0;
+        const auto& turn = seq.front();
+        if (seq.is_capture() || is_promotion(mtx[turn.x][turn.y], turn.x2))
+            return 0;
+        return std::min(lmr_reduction, search_depth - depth - 1);
+    }
+
+    // Converts a calc_score ratio into a negamax score. The opponent's ratio is the inverse one,
+    // so its logarithm is antisymmetric and negation switches the point of view.
+    static double to_negamax(const double score)
+    {
+        if (score >= INF)
+            return INF;
+        if (score <= 0)
+            return -INF;
+        return log(score);
+    }
+
+    // Captures of the piece on (x, y): a man jumps over the neighbouring opponent's checker (backwards too
+    // if V allows it), a flying queen over the first checker on the diagonal to any empty cell behind it
+    static void add_captures(const vector<vector<POS_T>>& mtx, const POS_T x, const POS_T y, hop_list& res)
+    {
+        const POS_T type = mtx[x][y];
+        const bool flying = (type > 2 && V::Flying_kings);
+        for (int d = 0; d < 4; ++d)
+        {
+            if (!V::Men_capture_backward && type <= 2 && Dir_x[d] != forward(type))
+                continue;
+            const auto& ray = geometry<V>.ray[x][y][d];
+            const POS_T len = geometry<V>.ray_len[x][y][d];
+            POS_T k = 0;
+            while (flying && k < len && !mtx[ray[k].x][ray[k].y])
+                ++k;
+            const POS_T target = (k < len ? mtx[ray[k].x][ray[k].y] : 0);
+            if (k + 1 >= len || !target || target % 2 == type % 2 || target == Captured)
+                continue;
+            for (POS_T l = k + 1; l < len && !mtx[ray[l].x][ray[l].y]; ++l)
+            {
+                res.push_back(move_pos(x, y, ray[l].x, ray[l].y, ray[k].x, ray[k].y));
+                if (!flying)
+                    break;
+            }
+        }
+    }
+
+    // Moves without captures of the piece on (x, y): men one cell forward, flying queens any distance
+    static void add_quiet_moves(const vector<vector<POS_T>>& mtx, const POS_T x, const POS_T y, hop_list& res)
+    {
+        const POS_T type = mtx[x][y];
+        const bool flying = (type > 2 && V::Flying_kings);
+        for (int d = 0; d < 4; ++d)
+        {
+            if (type <= 2 && Dir_x[d] != forward(type))
+                continue;
+            const auto& ray = geometry<V>.ray[x][y][d];
+            const POS_T len = geometry<V>.ray_len[x][y][d];
+            for (POS_T k = 0; k < len && !mtx[ray[k].x][ray[k].y]; ++k)
+            {
+                res.push_back(move_pos(x, y, ray[k].x, ray[k].y));
+                if (!flying)
+                    break;
+            }
+        }
+    }
+
+    // row direction of the men of the piece type: white ones go up to row 0, black ones down
+    static constexpr POS_T forward(const POS_T type)
+    {
+        return type % 2 ? -1 : 1;
+    }
+
+    // whether a man of the piece type becomes a queen on row x
+    static constexpr bool is_promotion(const POS_T type, const POS_T x)
+    {
+        return (type == 1 && x == 0) || (type == 2 && x == V::Size - 1);
+    }
+
+    // Follows the capture series seq of a piece of type to all its ends and adds them to res, see add_series.
+    // The last hop of seq is made on mtx for that and taken back afterwards.
+    template <class List>
+    static void extend_captures(vector<vector<POS_T>>& mtx, move_seq& seq, const POS_T type, const bool all_paths,
+        POS_T& longest, List& res)
+    {
+        const move_pos hop = seq.back();
+        const POS_T piece = mtx[hop.x][hop.y];
+        const POS_T captured = mtx[hop.xb][hop.yb];
+        apply_hop(mtx, hop, V::Promote_during_capture);
+        if constexpr (V::Remove_captured_after_series)
+            mtx[hop.xb][hop.yb] = Captured;
+
+        hop_list hops;
+        add_captures(mtx, hop.x2, hop.y2, hops);
+        if (hops.empty())
+            add_series(seq, type, all_paths, longest, res);
+        for (const auto& next : hops)
+        {
+            seq.push_back(next);
+            extend_captures(mtx, seq, type, all_paths, longest, res);
+            seq.pop_back();
+        }
+
+        mtx[hop.x2][hop.y2] = 0;
+        mtx[hop.xb][hop.yb] = captured;
+        mtx[hop.x][hop.y] = piece;
     }
 
+    // Adds the finished capture series seq of a piece of type to res. With the majority rule only the series
+    // of the most captures found so far (longest) are kept, a longer one clears res; unless all_paths is set,
+    // a series leading to the same position as one in res is left out. So res never holds more than the turns.
+    template <class List>
+    static void add_series(const move_seq& seq, const POS_T type, const bool all_paths, POS_T& longest, List& res)
+    {
+        if constexpr (V::Majority_capture)
+        {
+            if (seq.size < longest)
+                return;
+            if (seq.size > longest)
+            {
+                res.clear();
+                longest = seq.size;
+            }
+        }
+        if (all_paths || none_of(res.begin(), res.end(), [&](const move_seq& u) { return same_result(type, u, seq); }))
+            res.push_back(seq);
+    }
+
+    static bool same_turn(const move_pos& a, const move_pos& b)
+    {
+        return a.x == b.x && a.y == b.y && a.x2 == b.x2 && a.y2 == b.y2;
+    }
+
+public:
     // Calculates score of the board from bot perspective
     double calc_score(const vector<vector<POS_T>>& mtx, const bool first_bot_color) const
+    {
+        const bool potential = (scoring_mode == "NumberAndPotential");
+        if (first_bot_color)
+            return potential ? evaluate<true, true>(mtx) : evaluate<false, true>(mtx);
+        return potential ? evaluate<true, false>(mtx) : evaluate<false, false>(mtx);
+    }
+
+    // calc_score for the scoring mode and the bot color known at compile time, as the search calls it
+    template <bool Potential, bool Color> static double evaluate(const vector<vector<POS_T>>& mtx)
     {
         double w = 0, wq = 0, b = 0, bq = 0;
 
-        for (POS_T i = 0; i < 8; ++i)
+        for (POS_T i = 0; i < V::Size; ++i)
         {
-            for (POS_T j = 0; j < 8; ++j)
+            for (POS_T j = 0; j < V::Size; ++j)
             {
                 w += (mtx[i][j] == 1);
                 wq += (mtx[i][j] == 3);
                 b += (mtx[i][j] == 2);
                 bq += (mtx[i][j] == 4);
 
-                if (scoring_mode == "NumberAndPotential")
+                if constexpr (Potential)
                 {
-                    w += 0.05 * (mtx[i][j] == 1) * (7 - i);
+                    w += 0.05 * (mtx[i][j] == 1) * (V::Size - 1 - i);
                     b += 0.05 * (mtx[i][j] == 2) * (i);
                 }
             }
         }
 
-        if (!first_bot_color)
+        if constexpr (!Color)
         {
             swap(b, w);
             swap(bq, wq);
@@ -202,40 +1020,221 @@ private:
         if (b + bq == 0)
             return 0;
 
-        int q_coef = 4;
-        if (scoring_mode == "NumberAndPotential")
-            q_coef = 5;
+        const int q_coef = Potential ? 5 : 4;
 
         return (b + bq * q_coef) / (w + wq * q_coef);
     }
 
-public:
-    void find_turns(const bool color)
+    // whether the game on the board is drawn by the DrawRepetitions / DrawQuietTurns rules
+    bool is_game_drawn() const
+    {
+        return is_draw(draw_repetitions);
+    }
+
+    // All full turns of color, see generate_sequences
+    vector<move_seq> find_sequences(const vector<vector<POS_T>>& mtx, const bool color, const bool all_paths = false) const
     {
-        find_turns(color, board->get_board());
+        auto scratch = mtx;
+        if (all_paths)
+        {
+            // the paths of one capture can be more than a move_list holds
+            vector<move_seq> res;
+            generate_sequences(scratch, color, true, res);
+            return res;
+        }
+        move_list res;
+        generate_sequences(scratch, color, false, res);
+        return vector<move_seq>(res.begin(), res.end());
     }
 
-    void find_turns(const POS_T x, const POS_T y)
+    // Applies the specified move 'turn' to the given board matrix 'mtx'.
+    // A capture hop promotes a man only if V promotes during capture series.
+    vector<vector<POS_T>> make_turn(vector<vector<POS_T>> mtx, move_pos turn) const
     {
-        find_turns(x, y, board->get_board());
+        apply_hop(mtx, turn, V::Promote_during_capture || turn.xb == -1);
+        return mtx;
+    }
+
+    // Applies all hops of the full turn, the board is copied once
+    vector<vector<POS_T>> make_turn(vector<vector<POS_T>> mtx, const move_seq& seq) const
+    {
+        apply_turn(mtx, seq);
+        return mtx;
+    }
+
+    // a queen move without captures, the only kind of turn that can lead to a repetition; the draw rules
+    // count these, so everything that keeps a position history decides with it
+    static bool is_reversible(const vector<vector<POS_T>>& mtx, const move_seq& seq)
+    {
+        return !seq.is_capture() && mtx[seq.front().x][seq.front().y] > 2;
     }
 
 private:
-    void find_turns(const bool color, const vector<vector<POS_T>>& mtx);
-    void find_turns(const POS_T x, const POS_T y, const vector<vector<POS_T>>& mtx);
+    // All full turns of color: quiet moves or, if there is a capture, every capture series up to its end.
+    // Series with the same start, end, captured checkers and promotion lead to the same position,
+    // only the first of them is kept unless all_paths is set. mtx is changed on the way and restored.
+    // res is a move_list or, for all paths, a vector.
+    template <class List>
+    static void generate_sequences(vector<vector<POS_T>>& mtx, const bool color, const bool all_paths, List& res)
+    {
+        if (color)
+            generate_sequences<true>(mtx, all_paths, res);
+        else
+            generate_sequences<false>(mtx, all_paths, res);
+    }
+
+    template <bool Color, class List>
+    static void generate_sequences(vector<vector<POS_T>>& mtx, const bool all_paths, List& res)
+    {
+        res.clear();
+        hop_list hops;
+        for (POS_T i = 0; i < V::Size; ++i)
+        {
+            for (POS_T j = 0; j < V::Size; ++j)
+            {
+                if (mtx[i][j] && mtx[i][j] % 2 != Color)
+                    add_captures(mtx, i, j, hops);
+            }
+        }
+
+        if (!hops.empty())
+        {
+            move_seq seq;
+            POS_T longest = 0;
+            for (const auto& hop : hops)
+            {
+                seq = move_seq(hop);
+                extend_captures(mtx, seq, mtx[hop.x][hop.y], all_paths, longest, res);
+            }
+            return;
+        }
+
+        for (POS_T i = 0; i < V::Size; ++i)
+        {
+            for (POS_T j = 0; j < V::Size; ++j)
+            {
+                if (mtx[i][j] && mtx[i][j] % 2 != Color)
+                    add_quiet_moves(mtx, i, j, hops);
+            }
+        }
+        for (const auto& hop : hops)
+            res.push_back(move_seq(hop));
+    }
+
+    static bool same_result(const vector<vector<POS_T>>& mtx, const move_seq& a, const move_seq& b)
+    {
+        return same_turn(move_pos(a.front().x, a.front().y, a.back().x2, a.back().y2),
+            move_pos(b.front().x, b.front().y, b.back().x2, b.back().y2)) &&
+            a.captured() == b.captured() && promotes(mtx, a) == promotes(mtx, b);
+    }
+
+    // The same for two turns of a piece of type, while mtx is changed by the series
+    static bool same_result(const POS_T type, const move_seq& a, const move_seq& b)
+    {
+        return same_turn(move_pos(a.front().x, a.front().y, a.back().x2, a.back().y2),
+            move_pos(b.front().x, b.front().y, b.back().x2, b.back().y2)) &&
+            a.captured() == b.captured() && promotes(type, a) == promotes(type, b);
+    }
+
+    // Makes all hops of seq; with V::Remove_captured_after_series the captured checkers are taken off at its end
+    static void apply_turn(vector<vector<POS_T>>& mtx, const move_seq& seq)
+    {
+        for (POS_T i = 0; i < seq.size; ++i)
+        {
+            apply_hop(mtx, seq.hops[i], V::Promote_during_capture || i + 1 == seq.size);
+            if constexpr (V::Remove_captured_after_series)
+            {
+                if (seq.hops[i].xb != -1)
+                    mtx[seq.hops[i].xb][seq.hops[i].yb] = Captured;
+            }
+        }
+        if constexpr (V::Remove_captured_after_series)
+        {
+            for (const auto& hop : seq)
+            {
+                if (hop.xb != -1)
+                    mtx[hop.xb][hop.yb] = 0;
+            }
+        }
+    }
+
+    // promote - a man on the last row becomes a queen
+    static void apply_hop(vector<vector<POS_T>>& mtx, const move_pos& turn, const bool promote)
+    {
+        if (turn.xb != -1)
+            mtx[turn.xb][turn.yb] = 0;
+
+        if (promote && is_promotion(mtx[turn.x][turn.y], turn.x2))
+            mtx[turn.x][turn.y] += 2;
+
+        mtx[turn.x2][turn.y2] = mtx[turn.x][turn.y];
+        mtx[turn.x][turn.y] = 0;
+    }
+
+    // whether a man making the turn becomes a queen
+    static bool promotes(const vector<vector<POS_T>>& mtx, const move_seq& seq)
+    {
+        return promotes(mtx[seq.front().x][seq.front().y], seq);
+    }
+
+    static bool promotes(const POS_T type, const move_seq& seq)
+    {
+        if (!V::Promote_during_capture)
+            return is_promotion(type, seq.back().x2);
+        return any_of(seq.begin(), seq.end(), [type](const move_pos& hop) { return is_promotion(type, hop.x2); });
+    }
 
 public:
-    vector<move_pos> turns;
-    bool have_beats;
     int Max_depth;
+    // number of positions visited by the last find_best_turns
+    size_t nodes = 0;
+    // ProbCut pairs (empty - ProbCut is off) and the threshold in standard deviations of the prediction error
+    vector<probcut_pair> probcut;
+    double probcut_threshold = 0;
+    // samples of the find_best_turns searches go here if it is set, see TreeRecorder
+    shared_ptr<TreeRecorder> recorder;
+    // exact results of Tools/solve used by the search (UseSolved), see load_solved
+    unordered_map<uint64_t, solved_position> solved;
+    // results of earlier searches, none if it is not set (SearchCacheMB), see SearchCache
+    shared_ptr<SearchCache> cache;
+    // finished searches of root positions, none if it is not set (RootResults), see remember
+    shared_ptr<RootResults> root_results;
 
 private:
     std::default_random_engine rand_eng;
     std::string scoring_mode;
     std::string optimization;
-    std::vector<move_pos> next_move;
-    std::vector<int> next_best_state;
-    Board* board;
+    double aspiration_window;
+    size_t lmr_min_depth;
+    size_t lmr_move_index;
+    size_t lmr_reduction;
+    int draw_repetitions;
+    int draw_quiet_turns;
+    // mixed into the cache keys, see SearchCache::key
+    uint64_t cache_salt = 0;
+    // the same for the keys of root_results, see root_key
+    uint64_t root_salt = 0;
+    // draws by repetition met so far; they depend on the line, so no score above one goes to the cache
+    size_t repetition_draws = 0;
+    // depth of the current iteration
+    size_t search_depth = 0;
+    // killer move per depth
+    std::array<move_pos, Max_search_depth> killers;
+    // stack[ply] is the position after ply turns from the root
+    std::vector<search_ply> stack;
+    // triangular principal variation table, see pv_row
+    std::vector<move_seq> pv_table;
+    std::vector<size_t> pv_length;
+    // set when a limit is reached; the search then unwinds without using its scores
+    search_limits limits;
+    bool stopped = false;
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max();
+    BasicBoard<V>* board;
     Config* config;
+    PositionHistory* history;
+    // recorder of the current search, null if it is not recorded
+    TreeRecorder* recording = nullptr;
 };
 
+typedef BasicLogic<Russian> Logic;
+
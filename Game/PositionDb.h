@@ -0,0 +1,388 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Board.h"
+#include "Config.h"
+#include "Fen.h"
+#include "Logic.h"
+
+// Index of the positions reached in a collection of games: for a position hash, the games that
+// reached it (game id, ply) and how they ended. Built once by PositionDbBuilder, then opened with
+// PositionDb by mapping the file into memory, so a lookup is a binary search in the page cache.
+//
+// File layout (native byte order), every part 8-byte aligned:
+//     db_header
+//     uint64_t source offset of every game, by game id
+//     db_entry of every position of every game, sorted by (position hash, game id, ply)
+//     db_key of every distinct position, sorted by hash; its entries are entries[first, first + count)
+
+// result of a game for the statistics
+enum class game_result : uint8_t
+{
+    white_wins,
+    draw,
+    black_wins,
+    unknown
+};
+
+struct db_header
+{
+    char magic[8];
+    uint64_t games;
+    uint64_t entries;
+    uint64_t keys;
+    uint64_t offsets_at;
+    uint64_t entries_at;
+    uint64_t keys_at;
+};
+
+struct db_entry
+{
+    uint32_t game;
+    // plies from the start position of the game
+    uint16_t ply;
+    game_result result;
+    uint8_t reserved;
+};
+
+struct db_key
+{
+    uint64_t hash;
+    uint64_t first;
+    uint32_t count;
+    // distinct games that reached the position, and how many of them each side won or drew
+    uint32_t games;
+    uint32_t white_wins;
+    uint32_t draws;
+    uint32_t black_wins;
+    uint32_t reserved;
+};
+
+const char Db_magic[8] = { 'C', 'K', 'P', 'O', 'S', 'D', 'B', '1' };
+
+// Replays games with the engine's move generation and writes the index. Positions are collected
+// in memory up to the given budget, then sorted runs are spilled next to the output file and merged
+// at the end, so collections larger than memory can be indexed.
+class PositionDbBuilder
+{
+public:
+    PositionDbBuilder(const string& path, Config* config, const size_t memory_mb = 512)
+        : path(path), logic(&board, config), max_records(std::max<size_t>(memory_mb * 1024 * 1024 / sizeof(record), 1024))
+    {
+    }
+
+    ~PositionDbBuilder()
+    {
+        for (const auto& run : runs)
+            remove(run.c_str());
+    }
+
+    // Adds the game from the position fen (or "start") through the turns (as in Fen::turn_to_string, a capture
+    // may also be given by its first and last cells only: "26x10"). source_offset is kept for the game id,
+    // e.g. where the game is in its file. Returns the game id; an illegal turn throws and nothing is added.
+    uint32_t add_game(const string& fen, const vector<string>& turns, const game_result result, const uint64_t source_offset)
+    {
+        if (offsets.size() > UINT32_MAX)
+            throw runtime_error("too many games");
+        if (turns.size() > UINT16_MAX)
+            throw runtime_error("game is too long");
+        const uint32_t game = uint32_t(offsets.size());
+        vector<vector<POS_T>> mtx;
+        bool color;
+        Fen::parse(fen, mtx, color);
+
+        game_records.clear();
+        game_records.push_back({ Zobrist::hash(mtx, color), game, 0, result });
+        for (const auto& turn : turns)
+        {
+            mtx = logic.make_turn(mtx, find_turn(mtx, color, turn));
+            color = !color;
+            game_records.push_back({ Zobrist::hash(mtx, color), game, uint16_t(game_records.size()), result });
+        }
+
+        offsets.push_back(source_offset);
+        for (const auto& r : game_records)
+        {
+            records.push_back(r);
+            if (records.size() >= max_records)
+                spill();
+        }
+        return game;
+    }
+
+    size_t games() const
+    {
+        return offsets.size();
+    }
+
+    // Merges everything collected into the index file
+    void finish()
+    {
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out)
+            throw runtime_error("can't write " + path);
+        db_header header{};
+        memcpy(header.magic, Db_magic, sizeof(Db_magic));
+        header.games = offsets.size();
+        header.offsets_at = sizeof(db_header);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+        header.entries_at = sizeof(db_header) + offsets.size() * sizeof(uint64_t);
+
+        // the keys are only known after all entries, they wait in a temporary file
+        const string keys_path = path + ".keys";
+        ofstream keys_out(keys_path, ios::binary | ios::trunc);
+        db_key key{};
+        bool have_key = false;
+        auto put = [&](const record& r) {
+            if (!have_key || r.hash != key.hash)
+            {
+                if (have_key)
+                {
+                    keys_out.write(reinterpret_cast<const char*>(&key), sizeof(key));
+                    ++header.keys;
+                }
+                key = db_key{};
+                key.hash = r.hash;
+                key.first = header.entries;
+                have_key = true;
+            }
+            // a game reaching the position again (a repetition) counts once
+            if (!key.count || r.game != last_game)
+            {
+                ++key.games;
+                key.white_wins += (r.result == game_result::white_wins);
+                key.draws += (r.result == game_result::draw);
+                key.black_wins += (r.result == game_result::black_wins);
+            }
+            last_game = r.game;
+            ++key.count;
+            const db_entry entry{ r.game, r.ply, r.result, 0 };
+            out.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+            ++header.entries;
+        };
+
+        if (runs.empty())
+        {
+            sort(records.begin(), records.end());
+            for (const auto& r : records)
+                put(r);
+        }
+        else
+        {
+            spill();
+            merge_runs(put);
+        }
+        if (have_key)
+        {
+            keys_out.write(reinterpret_cast<const char*>(&key), sizeof(key));
+            ++header.keys;
+        }
+        keys_out.close();
+        records.clear();
+        records.shrink_to_fit();
+
+        header.keys_at = header.entries_at + header.entries * sizeof(db_entry);
+        ifstream keys_in(keys_path, ios::binary);
+        if (header.keys)
+            out << keys_in.rdbuf();
+        keys_in.close();
+        remove(keys_path.c_str());
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (!out)
+            throw runtime_error("can't write " + path);
+    }
+
+private:
+    struct record
+    {
+        uint64_t hash;
+        uint32_t game;
+        uint16_t ply;
+        game_result result;
+
+        bool operator<(const record& other) const
+        {
+            if (hash != other.hash)
+                return hash < other.hash;
+            return game != other.game ? game < other.game : ply < other.ply;
+        }
+    };
+
+    const move_seq& find_turn(const vector<vector<POS_T>>& mtx, const bool color, const string& text)
+    {
+        seqs = logic.find_sequences(mtx, color);
+        // only the turns from the first cell of the text are written out and compared
+        const int from = atoi(text.c_str());
+        seqs.erase(remove_if(seqs.begin(), seqs.end(),
+                       [from](const move_seq& seq) { return Fen::square(seq.front().x, seq.front().y) != from; }),
+            seqs.end());
+        for (const auto& seq : seqs)
+        {
+            if (Fen::turn_to_string(seq.to_vector()) == text)
+                return seq;
+        }
+        // the short form names a capture series only if no other one has the same first and last cells
+        const move_seq* found = nullptr;
+        for (const auto& seq : seqs)
+        {
+            if (seq.is_capture() && to_string(Fen::square(seq.front().x, seq.front().y)) + "x" +
+                                        to_string(Fen::square(seq.back().x2, seq.back().y2)) == text)
+            {
+                if (found)
+                    throw runtime_error("ambiguous turn " + text);
+                found = &seq;
+            }
+        }
+        if (!found)
+            throw runtime_error("illegal turn " + text);
+        return *found;
+    }
+
+    // sorts the collected records into a run file
+    void spill()
+    {
+        sort(records.begin(), records.end());
+        runs.push_back(path + ".run" + to_string(runs.size()));
+        ofstream out(runs.back(), ios::binary | ios::trunc);
+        out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(record));
+        if (!out)
+            throw runtime_error("can't write " + runs.back());
+        records.clear();
+    }
+
+    template <class Put> void merge_runs(Put& put)
+    {
+        vector<ifstream> ins;
+        for (const auto& run : runs)
+            ins.emplace_back(run, ios::binary);
+        typedef pair<record, size_t> head;
+        auto later = [](const head& a, const head& b) { return b.first < a.first; };
+        priority_queue<head, vector<head>, decltype(later)> heads(later);
+        record r;
+        for (size_t i = 0; i < ins.size(); ++i)
+        {
+            if (ins[i].read(reinterpret_cast<char*>(&r), sizeof(r)))
+                heads.push({ r, i });
+        }
+        while (!heads.empty())
+        {
+            const auto [top, i] = heads.top();
+            heads.pop();
+            put(top);
+            if (ins[i].read(reinterpret_cast<char*>(&r), sizeof(r)))
+                heads.push({ r, i });
+        }
+    }
+
+    string path;
+    Board board;
+    Logic logic;
+    size_t max_records;
+    vector<record> records;
+    vector<record> game_records;
+    vector<move_seq> seqs;
+    vector<uint64_t> offsets;
+    vector<string> runs;
+    uint32_t last_game = 0;
+};
+
+// Read-only view of an index written by PositionDbBuilder
+class PositionDb
+{
+public:
+    explicit PositionDb(const string& path)
+    {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw runtime_error("can't open " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(db_header))
+        {
+            close(fd);
+            throw runtime_error(path + " is not a position database");
+        }
+        size = size_t(st.st_size);
+        data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+            throw runtime_error("can't map " + path);
+
+        header = static_cast<const db_header*>(data);
+        if (memcmp(header->magic, Db_magic, sizeof(Db_magic)) != 0 ||
+            header->offsets_at + header->games * sizeof(uint64_t) > size ||
+            header->entries_at + header->entries * sizeof(db_entry) > size ||
+            header->keys_at + header->keys * sizeof(db_key) > size)
+        {
+            munmap(data, size);
+            throw runtime_error(path + " is not a position database");
+        }
+        const char* base = static_cast<const char*>(data);
+        offsets = reinterpret_cast<const uint64_t*>(base + header->offsets_at);
+        entries_begin = reinterpret_cast<const db_entry*>(base + header->entries_at);
+        keys_begin = reinterpret_cast<const db_key*>(base + header->keys_at);
+    }
+
+    ~PositionDb()
+    {
+        munmap(data, size);
+    }
+
+    PositionDb(const PositionDb&) = delete;
+    PositionDb& operator=(const PositionDb&) = delete;
+
+    // the statistics of the position, nullptr if no game reached it
+    const db_key* find(const uint64_t hash) const
+    {
+        const db_key* end = keys_begin + header->keys;
+        const db_key* it = lower_bound(keys_begin, end, hash, [](const db_key& k, const uint64_t h) { return k.hash < h; });
+        return (it != end && it->hash == hash) ? it : nullptr;
+    }
+
+    const db_key* find(const vector<vector<POS_T>>& mtx, const bool color) const
+    {
+        return find(Zobrist::hash(mtx, color));
+    }
+
+    // the occurrences of the position, by game id and ply
+    const db_entry* entries(const db_key& key) const
+    {
+        return entries_begin + key.first;
+    }
+
+    uint64_t source_offset(const uint32_t game) const
+    {
+        return offsets[game];
+    }
+
+    uint64_t games() const
+    {
+        return header->games;
+    }
+
+    uint64_t positions() const
+    {
+        return header->keys;
+    }
+
+private:
+    void* data = nullptr;
+    size_t size = 0;
+    const db_header* header = nullptr;
+    const uint64_t* offsets = nullptr;
+    const db_entry* entries_begin = nullptr;
+    const db_key* keys_begin = nullptr;
+};
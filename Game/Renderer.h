@@ -0,0 +1,363 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __APPLE__
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#else
+#include <SDL.h>
+#include <SDL_image.h>
+#endif
+
+#include "../Models/Frame.h"
+#include "Textures.h"
+#include "Trace.h"
+#include "TripleBuffer.h"
+
+// Draws the board_frame published by the game thread for the board of variant V.
+// With a render thread the renderer, the textures and every draw call live on that thread: it takes the
+// newest frame from a TripleBuffer, so the game never waits for the GPU driver or vsync, and it draws
+// the sliding hops frame by frame at the display rate (SDL_RenderPresent waits for vsync). Without it
+// publish() draws on the calling thread and returns once the slides of the frame are played.
+template <class V>
+class BasicRenderer
+{
+public:
+    BasicRenderer() = default;
+    BasicRenderer(const BasicRenderer&) = delete;
+    BasicRenderer& operator=(const BasicRenderer&) = delete;
+
+    ~BasicRenderer()
+    {
+        stop();
+    }
+
+    // Makes the renderer of win and the textures of loader, on the render thread if threaded;
+    // false on an error (written to log.txt of the project directory path)
+    bool start(SDL_Window* win, TextureLoader& loader, const std::string& path, const bool threaded)
+    {
+        textures_path = path + "Textures/";
+        log_path = path + "log.txt";
+        this->win = win;
+        this->threaded = threaded;
+        if (!threaded)
+            return init(loader) || fail();
+
+        std::promise<bool> ready;
+        auto started = ready.get_future();
+        worker = std::thread([this, &loader, ready = std::move(ready)]() mutable {
+            Trace::name_thread("render");
+            const bool ok = init(loader);
+            ready.set_value(ok);
+            if (ok)
+                run();
+            release();
+        });
+        if (started.get())
+            return true;
+        worker.join();
+        return fail();
+    }
+
+    // Stops the render thread and frees the renderer; the window stays
+    void stop()
+    {
+        if (worker.joinable())
+        {
+            quitting.store(true, std::memory_order_release);
+            worker.join();
+        }
+        release();
+    }
+
+    bool started() const
+    {
+        return win != nullptr;
+    }
+
+    // the frame publish() hands over, the caller sets all of it
+    board_frame& next_frame()
+    {
+        return frames.back();
+    }
+
+    void publish()
+    {
+        frames.publish();
+        if (threaded)
+            return;
+        frames.update();
+        const auto& frame = frames.front();
+        for (auto now = std::chrono::steady_clock::now();; now = std::chrono::steady_clock::now())
+        {
+            draw(frame, now);
+            if (!is_sliding(frame, now))
+                break;
+        }
+        // next rows for mac os
+        Trace::Span delay_span("rerender_delay");
+        SDL_Delay(10);
+        SDL_PumpEvents();
+    }
+
+private:
+    // a piece on its way: its type and the cell it is on, fractional
+    struct sliding_piece
+    {
+        POS_T type;
+        double x, y;
+    };
+
+    // how long the render thread sleeps when there is nothing new to draw
+    static const int Idle_ms = 4;
+
+    bool fail()
+    {
+        release();
+        win = nullptr;
+        return false;
+    }
+
+    bool init(TextureLoader& loader)
+    {
+        ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+        if (ren == nullptr)
+        {
+            print_exception("SDL_CreateRenderer can't create renderer");
+            return false;
+        }
+        Trace::Span load_span("load_textures");
+        if (!loader.make_textures(ren, board, atlas, sprites))
+        {
+            print_exception("can't load main textures from " + textures_path + ": " + loader.error);
+            return false;
+        }
+        return true;
+    }
+
+    // Loop of the render thread: a frame is drawn when a newer one is published and while its hops
+    // slide, once more when they stop
+    void run()
+    {
+        uint64_t drawn = 0;
+        bool sliding = false;
+        while (!quitting.load(std::memory_order_acquire))
+        {
+            frames.update();
+            const auto& frame = frames.front();
+            const auto now = std::chrono::steady_clock::now();
+            const bool was_sliding = sliding;
+            sliding = is_sliding(frame, now);
+            if (frame.version == drawn && !sliding && !was_sliding)
+            {
+                SDL_Delay(Idle_ms);
+                continue;
+            }
+            draw(frame, now);
+            drawn = frame.version;
+        }
+    }
+
+    void release()
+    {
+        if (result_texture)
+            SDL_DestroyTexture(result_texture);
+        if (board)
+            SDL_DestroyTexture(board);
+        if (atlas)
+            SDL_DestroyTexture(atlas);
+        if (ren)
+            SDL_DestroyRenderer(ren);
+        result_texture = board = atlas = nullptr;
+        ren = nullptr;
+    }
+
+    static bool is_sliding(const board_frame& frame, const std::chrono::steady_clock::time_point now)
+    {
+        return !frame.hops.empty() &&
+            std::chrono::duration<double, std::milli>(now - frame.hops.back().start).count() < frame.hops.back().ms;
+    }
+
+    // mtx is the position of the frame with the hops not finished at `now` taken back,
+    // the hop sliding at `now` goes to sliding
+    void place_pieces(const board_frame& frame, const std::chrono::steady_clock::time_point now)
+    {
+        mtx = frame.mtx;
+        sliding.clear();
+        for (auto it = frame.hops.rbegin(); it != frame.hops.rend(); ++it)
+        {
+            const double t = std::chrono::duration<double, std::milli>(now - it->start).count() / it->ms;
+            // the hops before a finished one are finished as well
+            if (t >= 1)
+                break;
+            const auto& hop = it->hop;
+            mtx[hop.x2][hop.y2] = 0;
+            if (hop.xb != -1)
+                mtx[hop.xb][hop.yb] = it->captured;
+            if (t < 0)
+            {
+                mtx[hop.x][hop.y] = it->piece;
+                continue;
+            }
+            mtx[hop.x][hop.y] = 0;
+            sliding.push_back({ it->piece, hop.x + (hop.x2 - hop.x) * t, hop.y + (hop.y2 - hop.y) * t });
+        }
+    }
+
+    void draw(const board_frame& frame, const std::chrono::steady_clock::time_point now)
+    {
+        Trace::Span span("draw_frame");
+        SDL_GetRendererOutputSize(ren, &W, &H);
+        // the window is Cells cells wide: the board and a frame of one cell
+        const int Cells = V::Size + 2;
+
+        // draw board, the picture is of the 8x8 one, others are drawn cell by cell
+        SDL_RenderClear(ren);
+        if (V::Size == 8)
+            SDL_RenderCopy(ren, board, NULL, NULL);
+        else
+            draw_cells();
+
+        // draw pieces, the sliding ones on top
+        place_pieces(frame, now);
+        for (POS_T i = 0; i < V::Size; ++i)
+        {
+            for (POS_T j = 0; j < V::Size; ++j)
+            {
+                if (mtx[i][j])
+                    draw_piece(mtx[i][j], i, j);
+            }
+        }
+        for (const auto& piece : sliding)
+            draw_piece(piece.type, piece.x, piece.y);
+
+        // draw hilight
+        SDL_SetRenderDrawColor(ren, 0, 255, 0, 0);
+        const double scale = 2.5;
+        SDL_RenderSetScale(ren, scale, scale);
+        for (POS_T i = 0; i < V::Size; ++i)
+        {
+            for (POS_T j = 0; j < V::Size; ++j)
+            {
+                if (!frame.highlighted[i][j])
+                    continue;
+                SDL_Rect cell{ int(W * (j + 1) / Cells / scale), int(H * (i + 1) / Cells / scale), int(W / Cells / scale),
+                              int(H / Cells / scale) };
+                SDL_RenderDrawRect(ren, &cell);
+            }
+        }
+
+        // draw active
+        if (frame.active_x != -1)
+        {
+            SDL_SetRenderDrawColor(ren, 255, 0, 0, 0);
+            SDL_Rect active_cell{ int(W * (frame.active_y + 1) / Cells / scale),
+                                  int(H * (frame.active_x + 1) / Cells / scale), int(W / Cells / scale),
+                                  int(H / Cells / scale) };
+            SDL_RenderDrawRect(ren, &active_cell);
+        }
+        SDL_RenderSetScale(ren, 1, 1);
+
+        // draw arrows
+        SDL_Rect rect_left{ W / 40, H / 40, W / 15, H / 15 };
+        SDL_RenderCopy(ren, atlas, &sprites[TextureLoader::Back_button], &rect_left);
+        SDL_Rect replay_rect{ W * 109 / 120, H / 40, W / 15, H / 15 };
+        SDL_RenderCopy(ren, atlas, &sprites[TextureLoader::Replay_button], &replay_rect);
+
+        // draw result, its picture is loaded once per result
+        if (frame.game_results != result_shown)
+            load_result(frame.game_results);
+        if (result_texture)
+        {
+            SDL_Rect res_rect{ W / 5, H * 3 / 10, W * 3 / 5, H * 2 / 5 };
+            SDL_RenderCopy(ren, result_texture, NULL, &res_rect);
+        }
+
+        SDL_RenderPresent(ren);
+    }
+
+    // the piece type on the cell (x, y), which may be between cells while it slides
+    void draw_piece(const POS_T type, const double x, const double y)
+    {
+        const int Cells = V::Size + 2;
+        SDL_Rect rect{ int(W * (y + 1) / Cells) + W / (12 * Cells), int(H * (x + 1) / Cells) + H / (12 * Cells),
+                       W * 5 / (6 * Cells), H * 5 / (6 * Cells) };
+        // the sprites of the pieces are in the order of their types
+        SDL_RenderCopy(ren, atlas, &sprites[TextureLoader::White_man + type - 1], &rect);
+    }
+
+    void load_result(const int game_results)
+    {
+        if (result_texture)
+            SDL_DestroyTexture(result_texture);
+        result_texture = nullptr;
+        result_shown = game_results;
+        if (game_results == -1)
+            return;
+        std::string result_path = textures_path + "draw.png";
+        if (game_results == 1)
+            result_path = textures_path + "white_wins.png";
+        else if (game_results == 2)
+            result_path = textures_path + "black_wins.png";
+        Trace::Span load_span("load_result_texture");
+        result_texture = IMG_LoadTexture(ren, result_path.c_str());
+        if (result_texture == nullptr)
+            print_exception("IMG_LoadTexture can't load game result picture from " + result_path);
+    }
+
+    // board without a picture: a frame and the light and dark cells
+    void draw_cells()
+    {
+        const int Cells = V::Size + 2;
+        SDL_SetRenderDrawColor(ren, 92, 58, 33, 255);
+        SDL_Rect frame{ 0, 0, W, H };
+        SDL_RenderFillRect(ren, &frame);
+        for (POS_T i = 0; i < V::Size; ++i)
+        {
+            for (POS_T j = 0; j < V::Size; ++j)
+            {
+                if ((i + j) % 2)
+                    SDL_SetRenderDrawColor(ren, 118, 78, 46, 255);
+                else
+                    SDL_SetRenderDrawColor(ren, 238, 214, 176, 255);
+                SDL_Rect cell{ W * (j + 1) / Cells, H * (i + 1) / Cells, W / Cells + 1, H / Cells + 1 };
+                SDL_RenderFillRect(ren, &cell);
+            }
+        }
+    }
+
+    // SDL keeps the error text per thread, so it is taken on the thread that got it
+    void print_exception(const std::string& text) const
+    {
+        std::ofstream fout(log_path, std::ios_base::app);
+        fout << "Error: " << text << ". " << SDL_GetError() << std::endl;
+    }
+
+    std::string textures_path;
+    std::string log_path;
+    SDL_Window* win = nullptr;
+    SDL_Renderer* ren = nullptr;
+    // textures: the board and the atlas of the pieces and buttons, sprites are their rects in it
+    SDL_Texture* board = nullptr;
+    SDL_Texture* atlas = nullptr;
+    SDL_Rect sprites[TextureLoader::Sprites]{};
+    // picture of the game result shown, -1 - none
+    SDL_Texture* result_texture = nullptr;
+    int result_shown = -1;
+    // size of the drawing area in pixels
+    int W = 0;
+    int H = 0;
+    bool threaded = false;
+    std::thread worker;
+    std::atomic<bool> quitting{ false };
+    TripleBuffer<board_frame> frames;
+    // the position drawn and the pieces sliding on it, see place_pieces
+    std::vector<std::vector<POS_T>> mtx;
+    std::vector<sliding_piece> sliding;
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "../Models/Analysis.h"
+
+// Finished searches of root positions (see Logic::root_results), the most recently used ones up to
+// a fixed number. The bot looks its position up before searching: after an undo, in a replayed
+// opening or when the expected reply was played, the search starts from what is known.
+class RootResults
+{
+public:
+    explicit RootResults(const size_t capacity) : capacity(capacity)
+    {
+        entries.reserve(capacity);
+    }
+
+    // the result of the position of key, nullptr if there is none
+    const root_result* find(const uint64_t key)
+    {
+        for (auto& entry : entries)
+        {
+            if (entry.key == key)
+            {
+                entry.used = ++clock;
+                return &entry.result;
+            }
+        }
+        return nullptr;
+    }
+
+    // keeps result for the position of key unless a deeper one is known,
+    // the least recently used position makes room for it
+    void put(const uint64_t key, root_result result)
+    {
+        for (auto& entry : entries)
+        {
+            if (entry.key == key)
+            {
+                if (result.depth >= entry.result.depth)
+                    entry.result = std::move(result);
+                entry.used = ++clock;
+                return;
+            }
+        }
+        if (!capacity)
+            return;
+        if (entries.size() < capacity)
+        {
+            entries.push_back({ key, ++clock, std::move(result) });
+            return;
+        }
+        auto oldest = entries.begin();
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (it->used < oldest->used)
+                oldest = it;
+        }
+        *oldest = { key, ++clock, std::move(result) };
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+    void clear()
+    {
+        entries.clear();
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t key;
+        uint64_t used;
+        root_result result;
+    };
+
+    size_t capacity;
+    uint64_t clock = 0;
+    std::vector<Entry> entries;
+};
@@ -0,0 +1,395 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../Models/SearchCache.h"
+
+// Transposition table of the search (Logic::cache): for a position, the score of its last search with
+// the plies searched below it, whether the score is exact or a bound, and the best turn, which is
+// searched first the next time. A bucket holds Bucket_size positions with the same low key bits; a new
+// result replaces the one of the same position if it is at least as deep, otherwise a free slot, then
+// the shallowest entry, entries of the current search counting Age_bonus plies deeper.
+//
+// The table outlives the session if it is saved: save writes the header and the table to a file, load
+// takes it back. A file of the same table size is mapped into memory copy-on-write, so only the pages
+// the search touches are ever read and a large file costs nothing at start; a file of another size is
+// read and its entries are merged in. On Windows the file is always read. Every entry checks itself
+// against its position, so a torn or damaged one is only a miss; the checksum of the whole table is
+// for Tools/cache.
+class SearchCache
+{
+public:
+    enum Bound : uint8_t
+    {
+        Empty = 0,
+        // the score is at most this: every turn failed low
+        Upper = 1,
+        // at least this: a turn failed high
+        Lower = 2,
+        Exact = 3,
+    };
+
+    static constexpr char Magic[8] = { 'C', 'K', 'C', 'A', 'C', 'H', 'E', '0' };
+    static const uint32_t Version = 1;
+    static const size_t Bucket_size = 4;
+    static const uint8_t No_cell = 255;
+    static const int Age_bonus = 4;
+
+    // An empty table of at most size_mb megabytes (a power of two buckets, one at least) for boards of board_size
+    SearchCache(const int board_size, const size_t size_mb) : board_size(board_size)
+    {
+        size_t buckets = 1;
+        while (buckets * 2 * Bucket_size * sizeof(cache_entry) <= (size_mb << 20))
+            buckets *= 2;
+        allocate(buckets);
+    }
+
+    ~SearchCache()
+    {
+        release();
+    }
+
+    SearchCache(const SearchCache&) = delete;
+    SearchCache& operator=(const SearchCache&) = delete;
+
+    // Key of the position with Zobrist hash `hash` reached after quiet_turns reversible turns in a row
+    // (the draw rule counts them). salt stands for everything else the scores depend on, see Logic.
+    static uint64_t key(const uint64_t hash, const int quiet_turns, const uint64_t salt)
+    {
+        return (hash ^ mix(salt ^ (uint64_t(quiet_turns) << 32))) | 1;
+    }
+
+    // the entry of the position of key, nullptr if there is none
+    const cache_entry* probe(const uint64_t key) const
+    {
+        return find(table + (key & (buckets - 1)) * Bucket_size, key);
+    }
+
+    // Keeps the result of a search of the position of key with depth plies below it; from and to are the
+    // cells of the best turn, No_cell keeps the turn of an earlier search of the position
+    void store(const uint64_t key, const double score, const int depth, const Bound bound, const uint8_t from,
+        const uint8_t to)
+    {
+        cache_entry* bucket = table + (key & (buckets - 1)) * Bucket_size;
+        cache_entry* slot = find(bucket, key);
+        cache_entry entry;
+        entry.score = score;
+        entry.depth = uint8_t(depth);
+        entry.bound = bound;
+        entry.from = from;
+        entry.to = to;
+        entry.age = age;
+        if (slot)
+        {
+            if (slot->depth > depth)
+                return;
+            if (from == No_cell)
+            {
+                entry.from = slot->from;
+                entry.to = slot->to;
+            }
+        }
+        else
+        {
+            slot = bucket;
+            for (size_t i = 0; i < Bucket_size && is_used(*slot); ++i)
+            {
+                if (!is_used(bucket[i]) || priority(bucket[i]) < priority(*slot))
+                    slot = bucket + i;
+            }
+        }
+        put(*slot, key, entry);
+    }
+
+    // Merges an entry of another table (Tools/cache): the deeper result of a position wins, and in a full
+    // bucket the shallowest entry gives way to a deeper one
+    void merge(const uint64_t key, const cache_entry& entry)
+    {
+        cache_entry* bucket = table + (key & (buckets - 1)) * Bucket_size;
+        if (cache_entry* same = find(bucket, key))
+        {
+            if (same->depth < entry.depth || (same->depth == entry.depth && entry.bound == Exact))
+                put(*same, key, entry);
+            return;
+        }
+        cache_entry* slot = bucket;
+        for (size_t i = 0; i < Bucket_size && is_used(*slot); ++i)
+        {
+            if (!is_used(bucket[i]) || bucket[i].depth < slot->depth)
+                slot = bucket + i;
+        }
+        if (!is_used(*slot) || slot->depth < entry.depth)
+            put(*slot, key, entry);
+    }
+
+    // Calls f(key, entry) for every intact entry
+    template <class F> void for_each(F&& f) const
+    {
+        for (size_t i = 0; i < capacity(); ++i)
+        {
+            if (is_used(table[i]))
+                f(table[i].check ^ fields(table[i]), table[i]);
+        }
+    }
+
+    // slots that are not free, torn entries included
+    size_t occupied() const
+    {
+        size_t res = 0;
+        for (size_t i = 0; i < capacity(); ++i)
+            res += (table[i].bound != Empty);
+        return res;
+    }
+
+    void clear()
+    {
+        std::fill(table, table + capacity(), cache_entry());
+    }
+
+    // Starts the next search: the entries of the earlier ones are replaced first
+    void new_search()
+    {
+        ++age;
+    }
+
+    // Takes the table of the file at path (see the class comment). own_size - the table becomes as large
+    // as the one of the file. false if there is no such file or it is not a table for board_size; the
+    // table is left as it is then.
+    bool load(const std::string& path, const bool own_size = false)
+    {
+        std::ifstream fin(path, std::ios::binary);
+        cache_header header{};
+        if (!fin.read(reinterpret_cast<char*>(&header), sizeof(header)) || !valid(header))
+            return false;
+        fin.seekg(0, std::ios::end);
+        if (uint64_t(fin.tellg()) != sizeof(header) + header.buckets * Bucket_size * sizeof(cache_entry))
+            return false;
+        loaded = header;
+        if (own_size || header.buckets == buckets)
+        {
+            fin.close();
+            if (!map(path, header.buckets))
+            {
+                allocate(header.buckets);
+                std::ifstream data(path, std::ios::binary);
+                data.seekg(sizeof(header));
+                data.read(reinterpret_cast<char*>(table), std::streamsize(capacity() * sizeof(cache_entry)));
+            }
+        }
+        else
+        {
+            fin.seekg(sizeof(header));
+            std::vector<cache_entry> chunk(Bucket_size * 4096);
+            const uint64_t total = header.buckets * Bucket_size;
+            for (uint64_t done = 0; done < total;)
+            {
+                const size_t n = size_t(std::min<uint64_t>(total - done, chunk.size()));
+                if (!fin.read(reinterpret_cast<char*>(chunk.data()), std::streamsize(n * sizeof(cache_entry))))
+                    break;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    // only intact entries: the key must lead to the bucket the entry was in
+                    const uint64_t key = chunk[i].check ^ fields(chunk[i]);
+                    if (chunk[i].bound != Empty && chunk[i].bound <= Exact &&
+                        (key & (header.buckets - 1)) == (done + i) / Bucket_size)
+                        merge(key, chunk[i]);
+                }
+                done += n;
+            }
+        }
+        age = uint8_t(header.age + 1);
+        return true;
+    }
+
+    // Writes the table to the file at path through a temporary file, so a failed save leaves the old file
+    bool save(const std::string& path) const
+    {
+        cache_header header{};
+        memcpy(header.magic, Magic, sizeof(Magic));
+        header.version = Version;
+        header.board_size = uint32_t(board_size);
+        header.buckets = buckets;
+        header.age = age;
+        header.checksum = checksum();
+        header.header_checksum = header_checksum(header);
+        const std::string tmp = path + ".tmp";
+        {
+            std::ofstream fout(tmp, std::ios::binary | std::ios::trunc);
+            fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            fout.write(reinterpret_cast<const char*>(table), std::streamsize(capacity() * sizeof(cache_entry)));
+            if (!fout)
+            {
+                fout.close();
+                std::remove(tmp.c_str());
+                return false;
+            }
+        }
+#ifdef _WIN32
+        std::remove(path.c_str());
+#endif
+        return std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    // of the table as save writes it
+    uint64_t checksum() const
+    {
+        const uint64_t* words = reinterpret_cast<const uint64_t*>(table);
+        uint64_t res = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < capacity() * sizeof(cache_entry) / sizeof(uint64_t); ++i)
+            res = (res ^ words[i]) * 0x100000001b3ULL;
+        return res;
+    }
+
+    // header of the file of the last load
+    const cache_header& file_header() const
+    {
+        return loaded;
+    }
+
+    size_t capacity() const
+    {
+        return buckets * Bucket_size;
+    }
+
+    // the table was mapped from its file rather than read
+    bool is_mapped() const
+    {
+        return mapped != nullptr;
+    }
+
+private:
+    // a reversible mix of the bits (the splitmix64 output function)
+    static uint64_t mix(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    // what check is xor-ed with besides the key
+    static uint64_t fields(const cache_entry& entry)
+    {
+        uint64_t score;
+        memcpy(&score, &entry.score, sizeof(score));
+        return mix(score ^ mix(uint64_t(entry.depth) | uint64_t(entry.bound) << 8 | uint64_t(entry.from) << 16 |
+                               uint64_t(entry.to) << 24 | uint64_t(entry.age) << 32));
+    }
+
+    static uint64_t header_checksum(const cache_header& header)
+    {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&header);
+        uint64_t res = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < offsetof(cache_header, header_checksum); ++i)
+            res = (res ^ bytes[i]) * 0x100000001b3ULL;
+        return res;
+    }
+
+    bool valid(const cache_header& header) const
+    {
+        return memcmp(header.magic, Magic, sizeof(Magic)) == 0 && header.version == Version &&
+            header.board_size == uint32_t(board_size) && header.buckets && !(header.buckets & (header.buckets - 1)) &&
+            header.header_checksum == header_checksum(header);
+    }
+
+    // the entry of key in bucket, nullptr if there is none
+    cache_entry* find(cache_entry* bucket, const uint64_t key) const
+    {
+        for (size_t i = 0; i < Bucket_size; ++i)
+        {
+            if (bucket[i].bound != Empty && (bucket[i].check ^ fields(bucket[i])) == key)
+                return bucket + i;
+        }
+        return nullptr;
+    }
+
+    // an intact entry in its bucket: a torn one gives a key of another bucket (almost always), its slot is free
+    bool is_used(const cache_entry& entry) const
+    {
+        return entry.bound != Empty && entry.bound <= Exact &&
+            ((entry.check ^ fields(entry)) & (buckets - 1)) == size_t(&entry - table) / Bucket_size;
+    }
+
+    // which entry of a full bucket a new position replaces: the lowest
+    int priority(const cache_entry& entry) const
+    {
+        return entry.depth + (entry.age == age ? Age_bonus : 0);
+    }
+
+    void put(cache_entry& slot, const uint64_t key, cache_entry entry)
+    {
+        entry.check = key ^ fields(entry);
+        slot = entry;
+    }
+
+    // zeroed memory from the system costs nothing until the search touches it, like a mapped file
+    void allocate(const size_t n)
+    {
+        release();
+        table = static_cast<cache_entry*>(std::calloc(n * Bucket_size, sizeof(cache_entry)));
+        if (!table)
+            throw std::bad_alloc();
+        buckets = n;
+    }
+
+    bool map(const std::string& path, const size_t n)
+    {
+#ifdef _WIN32
+        (void)path;
+        (void)n;
+        return false;
+#else
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        const size_t size = sizeof(cache_header) + n * Bucket_size * sizeof(cache_entry);
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+            return false;
+        release();
+        mapped = data;
+        mapped_size = size;
+        buckets = n;
+        table = reinterpret_cast<cache_entry*>(static_cast<char*>(data) + sizeof(cache_header));
+        return true;
+#endif
+    }
+
+    void release()
+    {
+#ifndef _WIN32
+        if (mapped)
+            munmap(mapped, mapped_size);
+#endif
+        if (!mapped)
+            std::free(table);
+        table = nullptr;
+        mapped = nullptr;
+        mapped_size = 0;
+    }
+
+    int board_size;
+    size_t buckets = 0;
+    // allocated here or inside the private mapping of its file
+    cache_entry* table = nullptr;
+    void* mapped = nullptr;
+    size_t mapped_size = 0;
+    uint8_t age = 0;
+    cache_header loaded{};
+};
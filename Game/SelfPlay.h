@@ -0,0 +1,660 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../Models/SelfPlay.h"
+#include "Board.h"
+#include "Config.h"
+#include "Fen.h"
+#include "Logic.h"
+#include "ThreadPool.h"
+
+// Distributed self-play: a coordinator hands the games of a selfplay_job out to worker processes on any
+// number of machines, and the workers play them headless with one Logic per thread. The results stream
+// back game by game and are appended to the results file at once. The file is also the state of the
+// job: a coordinator started again on it plays only the games missing there. A worker that disconnects
+// or goes silent for longer than the lease has its games handed to the others.
+//
+// Messages (native byte order): uint32 payload size, uint8 type, payload
+//     Hello   worker -> coordinator   uint32 threads
+//     Job     coordinator -> worker   the job: uint32 games, uint8 level, uint8 opening turns,
+//                                     uint16 max turns, uint64 seed
+//     Games   coordinator -> worker   uint32 count, the game indexes (uint32)
+//     Result  worker -> coordinator   a game record
+//     Stop    coordinator -> worker   no more games
+// Game record: uint32 index, uint8 result, uint64 nodes, uint32 ms, uint16 turns, then per turn uint8 cells
+// and the cells (uint8 each). Results file: "CKSELF01", the job as in Job, then game records.
+class SelfPlay
+{
+public:
+    enum Message : uint8_t
+    {
+        Hello = 1,
+        Job,
+        Games,
+        Result,
+        Stop,
+    };
+
+    static constexpr char Magic[8] = { 'C', 'K', 'S', 'E', 'L', 'F', '0', '1' };
+    // a larger message is a broken stream
+    static const uint32_t Max_message = 1 << 20;
+
+    // Plays game index of the job on board and logic: random legal turns for the opening, then the bot
+    // at the job's level for both sides, with the choice between equal turns seeded by the game
+    static selfplay_game play(Board& board, Logic& logic, const selfplay_job& job, const uint32_t index)
+    {
+        const auto start = chrono::steady_clock::now();
+        mt19937_64 rand_eng(job.seed * 0x9E3779B97F4A7C15ull + index);
+        logic.seed(unsigned(rand_eng()));
+        logic.Max_depth = job.level;
+        selfplay_game res;
+        res.index = index;
+        vector<vector<POS_T>> mtx;
+        bool color;
+        Fen::parse("start", mtx, color);
+        board.history.clear();
+        board.history.push(Zobrist::hash(mtx, color), false);
+        for (int turn_num = 0; turn_num < job.max_turns && !logic.is_game_drawn(); ++turn_num)
+        {
+            move_seq seq;
+            if (turn_num < job.opening_turns)
+            {
+                const auto seqs = logic.find_sequences(mtx, color);
+                if (!seqs.empty())
+                    seq = seqs[rand_eng() % seqs.size()];
+            }
+            else
+            {
+                for (const auto& hop : logic.find_best_turns(mtx, color))
+                    seq.push_back(hop);
+                res.nodes += logic.nodes;
+            }
+            if (!seq.size)
+            {
+                res.result = color ? 1 : 2;
+                break;
+            }
+            vector<uint8_t> cells{ uint8_t(seq.front().x * Russian::Size + seq.front().y) };
+            for (const auto& hop : seq)
+                cells.push_back(uint8_t(hop.x2 * Russian::Size + hop.y2));
+            res.turns.push_back(cells);
+            const bool reversible = Logic::is_reversible(mtx, seq);
+            mtx = logic.make_turn(mtx, seq);
+            color = !color;
+            board.history.push(Zobrist::hash(mtx, color), reversible);
+        }
+        res.ms = uint32_t(chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count());
+        return res;
+    }
+
+    static void put_job(string& out, const selfplay_job& job)
+    {
+        put(out, job.games);
+        put(out, job.level);
+        put(out, job.opening_turns);
+        put(out, job.max_turns);
+        put(out, job.seed);
+    }
+
+    static bool get_job(const string& in, size_t& at, selfplay_job& job)
+    {
+        return get(in, at, job.games) && get(in, at, job.level) && get(in, at, job.opening_turns) &&
+            get(in, at, job.max_turns) && get(in, at, job.seed);
+    }
+
+    static void put_game(string& out, const selfplay_game& game)
+    {
+        put(out, game.index);
+        put(out, game.result);
+        put(out, game.nodes);
+        put(out, game.ms);
+        put(out, uint16_t(game.turns.size()));
+        for (const auto& turn : game.turns)
+        {
+            put(out, uint8_t(turn.size()));
+            out.append(turn.begin(), turn.end());
+        }
+    }
+
+    // false if in ends before the record does; at is then undefined
+    static bool get_game(const string& in, size_t& at, selfplay_game& game)
+    {
+        uint16_t turns;
+        if (!get(in, at, game.index) || !get(in, at, game.result) || !get(in, at, game.nodes) ||
+            !get(in, at, game.ms) || !get(in, at, turns))
+            return false;
+        game.turns.resize(turns);
+        for (auto& turn : game.turns)
+        {
+            uint8_t cells;
+            if (!get(in, at, cells) || at + cells > in.size())
+                return false;
+            turn.assign(in.begin() + at, in.begin() + at + cells);
+            at += cells;
+        }
+        return true;
+    }
+
+    // Reads the job and the complete games of a results file (written by Coordinator); a broken last
+    // record is cut off
+    static vector<selfplay_game> read_results(const string& path, selfplay_job& job)
+    {
+        ifstream fin(path, ios::binary);
+        if (!fin)
+            throw runtime_error("can't open " + path);
+        const string data((istreambuf_iterator<char>(fin)), istreambuf_iterator<char>());
+        size_t at = sizeof(Magic);
+        if (data.compare(0, sizeof(Magic), Magic, sizeof(Magic)) != 0 || !get_job(data, at, job))
+            throw runtime_error(path + " is not a self-play results file");
+        vector<selfplay_game> res;
+        for (selfplay_game game; at < data.size();)
+        {
+            const size_t begin = at;
+            if (!get_game(data, at, game))
+            {
+                fin.close();
+                filesystem::resize_file(path, begin);
+                break;
+            }
+            res.push_back(game);
+        }
+        return res;
+    }
+
+    // Sends one message, false if the connection is lost
+    static bool send_message(const int fd, const Message type, const string& payload)
+    {
+        string data;
+        put(data, uint32_t(payload.size()));
+        put(data, uint8_t(type));
+        data += payload;
+        for (size_t sent = 0; sent < data.size();)
+        {
+            const auto n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+                return false;
+            sent += n;
+        }
+        return true;
+    }
+
+    // Takes the next complete message from the received bytes in input. False if there is none yet;
+    // broken is set if the stream can't be a message.
+    static bool next_message(string& input, Message& type, string& payload, bool& broken)
+    {
+        size_t at = 0;
+        uint32_t size;
+        uint8_t raw_type;
+        if (!get(input, at, size) || !get(input, at, raw_type))
+            return false;
+        if (size > Max_message || raw_type < Hello || raw_type > Stop)
+        {
+            broken = true;
+            return false;
+        }
+        if (input.size() < at + size)
+            return false;
+        type = Message(raw_type);
+        payload = input.substr(at, size);
+        input.erase(0, at + size);
+        return true;
+    }
+
+    class Worker;
+    class Coordinator;
+
+private:
+    template <class T> static void put(string& out, const T value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <class T> static bool get(const string& in, size_t& at, T& value)
+    {
+        if (at + sizeof(T) > in.size())
+            return false;
+        memcpy(&value, in.data() + at, sizeof(T));
+        at += sizeof(T);
+        return true;
+    }
+};
+
+// Connects to a coordinator and plays the games it sends on a pool of threads, each with its own Logic
+class SelfPlay::Worker
+{
+public:
+    Worker(Config* config, const size_t threads) : pool(threads)
+    {
+        for (size_t i = 0; i < threads; ++i)
+        {
+            boards.push_back(make_unique<Board>());
+            logics.push_back(make_unique<Logic>(boards.back().get(), config));
+        }
+    }
+
+    ~Worker()
+    {
+        stop = true;
+        pool.wait();
+        if (fd != -1)
+            close(fd);
+    }
+
+    // Gives every thread a search cache of size_mb MB, starting from the file at path if there is one
+    void use_caches(const size_t size_mb, const string& path)
+    {
+        for (auto& logic : logics)
+        {
+            logic->cache = make_shared<SearchCache>(Russian::Size, size_mb);
+            logic->cache->load(path);
+        }
+    }
+
+    // Writes the cache of every thread to path.<process id>.<thread>, for Tools/cache merge
+    bool save_caches(const string& path) const
+    {
+        bool res = true;
+        for (size_t i = 0; i < logics.size(); ++i)
+        {
+            if (logics[i]->cache)
+                res = logics[i]->cache->save(path + "." + to_string(getpid()) + "." + to_string(i)) && res;
+        }
+        return res;
+    }
+
+    // host - a name or an address
+    bool connect_tcp(const string& host, const int port)
+    {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found = nullptr;
+        if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &found) != 0)
+            return false;
+        for (auto ai = found; ai && fd == -1; ai = ai->ai_next)
+        {
+            fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd != -1 && ::connect(fd, ai->ai_addr, ai->ai_addrlen) != 0)
+            {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(found);
+        return fd != -1;
+    }
+
+    bool connect_unix(const string& path)
+    {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1 || path.size() >= sizeof(sockaddr_un::sun_path))
+            return false;
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        copy(path.begin(), path.end(), addr.sun_path);
+        return ::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+    }
+
+    // Plays games until the coordinator says stop (true) or the connection is lost (false)
+    bool run()
+    {
+        string hello;
+        put(hello, uint32_t(pool.size()));
+        if (!send(Hello, hello))
+            return false;
+        string input;
+        char buf[4096];
+        while (true)
+        {
+            Message type;
+            string payload;
+            bool broken = false;
+            while (next_message(input, type, payload, broken))
+            {
+                size_t at = 0;
+                if (type == Stop)
+                {
+                    // all the games are played, the ones still queued were given to others as well
+                    stop = true;
+                    pool.wait();
+                    return true;
+                }
+                if (type == Job && !get_job(payload, at, job))
+                    broken = true;
+                if (type == Games)
+                    broken = !queue_games(payload);
+            }
+            const auto n = broken ? 0 : recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0)
+                break;
+            input.append(buf, n);
+        }
+        // the games in the queue are not played any more, the coordinator gives them to others
+        stop = true;
+        pool.wait();
+        return false;
+    }
+
+private:
+    bool queue_games(const string& payload)
+    {
+        size_t at = 0;
+        uint32_t count, index;
+        if (!get(payload, at, count))
+            return false;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (!get(payload, at, index))
+                return false;
+            pool.push([this, index](const size_t worker) {
+                if (stop)
+                    return;
+                string record;
+                put_game(record, play(*boards[worker], *logics[worker], job, index));
+                send(Result, record);
+            });
+        }
+        return true;
+    }
+
+    bool send(const Message type, const string& payload)
+    {
+        lock_guard<mutex> lock(send_mtx);
+        return send_message(fd, type, payload);
+    }
+
+    int fd = -1;
+    selfplay_job job;
+    atomic<bool> stop{ false };
+    vector<unique_ptr<Board>> boards;
+    vector<unique_ptr<Logic>> logics;
+    mutex send_mtx;
+    ThreadPool pool;
+};
+
+// Hands the games of a job out to the workers that connect and appends their results to the results file
+class SelfPlay::Coordinator
+{
+public:
+    // Opens the results file at path: a new one, or an existing one of the same job to go on with it.
+    // lease_s - a worker silent for this long while it has games is given up.
+    Coordinator(const selfplay_job& job, const string& path, const double lease_s) : job(job), lease_s(lease_s)
+    {
+        if (filesystem::exists(path) && filesystem::file_size(path) > 0)
+        {
+            selfplay_job file_job;
+            const auto games = read_results(path, file_job);
+            if (!(file_job == job))
+                throw runtime_error(path + " holds the results of another job");
+            for (const auto& game : games)
+            {
+                if (game.index < job.games && done.insert(game.index).second)
+                    count(game);
+            }
+            resumed = done.size();
+        }
+        else
+        {
+            string header(Magic, sizeof(Magic));
+            put_job(header, job);
+            ofstream(path, ios::binary | ios::trunc).write(header.data(), header.size());
+        }
+        fout.open(path, ios::binary | ios::app);
+        if (!fout)
+            throw runtime_error("can't write " + path);
+        for (uint32_t i = 0; i < job.games; ++i)
+        {
+            if (!done.count(i))
+                pending.insert(i);
+        }
+    }
+
+    ~Coordinator()
+    {
+        for (auto& w : workers)
+            close(w.first);
+        if (listener != -1)
+            close(listener);
+    }
+
+    // Listens on port (0 - any free one, see port()) of 127.0.0.1, or of all addresses if any_address
+    bool listen_tcp(const int port, const bool any_address)
+    {
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (listener == -1)
+            return false;
+        const int yes = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(any_address ? INADDR_ANY : INADDR_LOOPBACK);
+        socklen_t size = sizeof(addr);
+        if (::bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, SOMAXCONN) != 0 ||
+            getsockname(listener, (sockaddr*)&addr, &size) != 0)
+            return false;
+        bound_port = ntohs(addr.sin_port);
+        return true;
+    }
+
+    bool listen_unix(const string& path)
+    {
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener == -1 || path.size() >= sizeof(sockaddr_un::sun_path))
+            return false;
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        copy(path.begin(), path.end(), addr.sun_path);
+        unlink(path.c_str());
+        return ::bind(listener, (sockaddr*)&addr, sizeof(addr)) == 0 && listen(listener, SOMAXCONN) == 0;
+    }
+
+    int port() const
+    {
+        return bound_port;
+    }
+
+    // Hands the games out until all of them are played (true) or stop is set (false).
+    // on_tick is called about every Poll_timeout_ms, e.g. to restart local workers.
+    bool run(const function<void()>& on_tick = nullptr)
+    {
+        started = chrono::steady_clock::now();
+        vector<pollfd> fds;
+        while (!stop && done.size() < job.games)
+        {
+            if (on_tick)
+                on_tick();
+            fds.assign(1, { listener, POLLIN, 0 });
+            for (const auto& w : workers)
+                fds.push_back({ w.first, POLLIN, 0 });
+            if (poll(fds.data(), fds.size(), Poll_timeout_ms) > 0)
+            {
+                if (fds[0].revents & POLLIN)
+                {
+                    const int fd = accept(listener, nullptr, nullptr);
+                    if (fd != -1)
+                        workers[fd].last_seen = chrono::steady_clock::now();
+                }
+                for (size_t i = 1; i < fds.size(); ++i)
+                {
+                    if (fds[i].revents && !receive(fds[i].fd))
+                        drop(fds[i].fd, "disconnected");
+                }
+            }
+            const auto now = chrono::steady_clock::now();
+            vector<int> silent;
+            for (const auto& w : workers)
+            {
+                if (!w.second.assigned.empty() && chrono::duration<double>(now - w.second.last_seen).count() > lease_s)
+                    silent.push_back(w.first);
+            }
+            for (const int fd : silent)
+                drop(fd, "silent for " + to_string(int(lease_s)) + " s");
+        }
+        for (const auto& w : workers)
+            send_message(w.first, Stop, "");
+        return done.size() >= job.games;
+    }
+
+    // Counts of the results file, the games of this run and their rate
+    json summary() const
+    {
+        const double hours = chrono::duration<double>(chrono::steady_clock::now() - started).count() / 3600;
+        const size_t played = done.size() - resumed;
+        return { { "games", job.games },
+                 { "done", done.size() },
+                 { "resumed", resumed },
+                 { "white_wins", results[1] },
+                 { "black_wins", results[2] },
+                 { "draws", results[0] },
+                 { "played", played },
+                 { "games_per_hour", hours > 0 ? played / hours : 0.0 },
+                 { "workers_seen", workers_seen },
+                 { "workers_lost", workers_lost },
+                 { "games_replayed", replayed } };
+    }
+
+    // set from another thread (or a signal handler) to stop handing games out
+    atomic<bool> stop{ false };
+
+private:
+    struct worker_state
+    {
+        string input;
+        uint32_t threads = 0;
+        // games given to the worker and not returned yet
+        set<uint32_t> assigned;
+        chrono::steady_clock::time_point last_seen;
+    };
+
+    // Reads from the worker on fd, false if it is gone or sends nonsense
+    bool receive(const int fd)
+    {
+        auto& w = workers[fd];
+        char buf[1 << 16];
+        const auto n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0)
+            return false;
+        w.input.append(buf, n);
+        w.last_seen = chrono::steady_clock::now();
+        Message type;
+        string payload;
+        bool broken = false;
+        while (!broken && next_message(w.input, type, payload, broken))
+        {
+            size_t at = 0;
+            if (type == Hello)
+            {
+                if (w.threads || !get(payload, at, w.threads) || !w.threads)
+                    return false;
+                ++workers_seen;
+                string job_payload;
+                put_job(job_payload, job);
+                if (!send_message(fd, Job, job_payload))
+                    return false;
+            }
+            else if (type == Result)
+            {
+                selfplay_game game;
+                if (!get_game(payload, at, game) || !w.assigned.erase(game.index))
+                    return false;
+                // played twice if it was lost with a worker that came back; the first result stays
+                if (done.insert(game.index).second)
+                {
+                    fout.write(payload.data(), payload.size());
+                    fout.flush();
+                    count(game);
+                }
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return !broken && hand_out(fd);
+    }
+
+    // Keeps two games per thread of the worker on fd in hand, so it never waits for the next ones
+    bool hand_out(const int fd)
+    {
+        auto& w = workers[fd];
+        if (!w.threads)
+            return true;
+        string payload;
+        uint32_t count = 0;
+        put(payload, count);
+        while (w.assigned.size() < 2 * w.threads && !pending.empty())
+        {
+            const uint32_t index = *pending.begin();
+            pending.erase(pending.begin());
+            w.assigned.insert(index);
+            put(payload, index);
+            ++count;
+        }
+        if (!count)
+            return true;
+        memcpy(&payload[0], &count, sizeof(count));
+        return send_message(fd, Games, payload);
+    }
+
+    // Gives the worker up: its games go back to the others
+    void drop(const int fd, const string& reason)
+    {
+        auto it = workers.find(fd);
+        if (it == workers.end())
+            return;
+        if (!it->second.assigned.empty())
+            cerr << "worker lost (" << reason << "), " << it->second.assigned.size() << " games go to others\n";
+        replayed += it->second.assigned.size();
+        pending.insert(it->second.assigned.begin(), it->second.assigned.end());
+        workers_lost += (it->second.threads > 0);
+        close(fd);
+        workers.erase(it);
+        for (auto& w : workers)
+            hand_out(w.first);
+    }
+
+    void count(const selfplay_game& game)
+    {
+        ++results[game.result % 3];
+    }
+
+    static const int Poll_timeout_ms = 200;
+
+    selfplay_job job;
+    double lease_s;
+    ofstream fout;
+    int listener = -1;
+    int bound_port = 0;
+    unordered_map<int, worker_state> workers;
+    // games not given to any worker, the lowest index first
+    set<uint32_t> pending;
+    set<uint32_t> done;
+    size_t resumed = 0;
+    size_t results[3] = { 0, 0, 0 };
+    size_t workers_seen = 0;
+    size_t workers_lost = 0;
+    size_t replayed = 0;
+    chrono::steady_clock::time_point started = chrono::steady_clock::now();
+};
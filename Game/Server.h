@@ -0,0 +1,495 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Board.h"
+#include "Config.h"
+#include "Fen.h"
+#include "Logic.h"
+#include "ThreadPool.h"
+
+// Game server: many bot games (sessions) in one process, driven over a local socket with a line
+// based protocol. A session is only a position and its recent history; the searches of all sessions
+// run on a shared worker pool, every worker with its own Logic, and all of them share one Config.
+// Commands (one per line, any number of connections, sessions are not bound to a connection):
+//     new [level D] [movetime MS] [fen <FEN>]   -> session <id>
+//     move <id> <turn>                          -> ok <id>
+//     go <id>                                   -> bestmove <id> <turn>|none  (the bot's turn is made)
+//     position <id>                             -> position <id> <FEN>
+//     close <id>                                -> ok <id>
+//     stats                                     -> stats sessions N workers W queued Q searches S p50 MS p99 MS
+//     quit
+// A turn that ends the game is followed by "gameover <id> white|black|draw". Errors are answered
+// with "error <text>". A session takes one search at a time; searches are run earliest deadline
+// first, the deadline being the time of "go" plus the session's movetime.
+class Server
+{
+public:
+    Server(Config* config, const size_t threads) : config(config), io_logic(&io_board, config), pool(threads)
+    {
+        for (size_t i = 0; i < threads; ++i)
+        {
+            boards.push_back(make_unique<Board>());
+            logics.push_back(make_unique<Logic>(boards.back().get(), config));
+        }
+    }
+
+    ~Server()
+    {
+        stop = true;
+        pool.wait();
+        if (listener != -1)
+            close(listener);
+    }
+
+    // Listens on 127.0.0.1:port; returns false if the socket can't be opened
+    bool listen_tcp(const int port)
+    {
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (listener == -1)
+            return false;
+        const int yes = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return ::bind(listener, (sockaddr*)&addr, sizeof(addr)) == 0 && listen(listener, SOMAXCONN) == 0;
+    }
+
+    // Listens on a Unix socket at path (an old socket file there is removed)
+    bool listen_unix(const string& path)
+    {
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener == -1 || path.size() >= sizeof(sockaddr_un::sun_path))
+            return false;
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        copy(path.begin(), path.end(), addr.sun_path);
+        unlink(path.c_str());
+        return ::bind(listener, (sockaddr*)&addr, sizeof(addr)) == 0 && listen(listener, SOMAXCONN) == 0;
+    }
+
+    // Serves the connections until stop is set
+    void run()
+    {
+        vector<pollfd> fds;
+        unordered_map<int, shared_ptr<Connection>> connections;
+        while (!stop)
+        {
+            fds.assign(1, { listener, POLLIN, 0 });
+            for (const auto& conn : connections)
+                fds.push_back({ conn.first, POLLIN, 0 });
+            if (poll(fds.data(), fds.size(), Poll_timeout_ms) <= 0)
+                continue;
+
+            if (fds[0].revents & POLLIN)
+            {
+                const int fd = accept(listener, nullptr, nullptr);
+                if (fd != -1)
+                    connections[fd] = make_shared<Connection>(fd);
+            }
+            for (size_t i = 1; i < fds.size(); ++i)
+            {
+                if (!fds[i].revents)
+                    continue;
+                auto conn = connections[fds[i].fd];
+                char buf[4096];
+                const auto n = recv(conn->fd, buf, sizeof(buf), 0);
+                bool open = (n > 0);
+                if (open)
+                {
+                    conn->input.append(buf, n);
+                    size_t end;
+                    while (open && (end = conn->input.find('\n')) != string::npos)
+                    {
+                        const string line = conn->input.substr(0, end);
+                        conn->input.erase(0, end + 1);
+                        open = handle(conn, line);
+                    }
+                }
+                if (!open)
+                {
+                    conn->close();
+                    connections.erase(fds[i].fd);
+                }
+            }
+        }
+        for (auto& conn : connections)
+            conn.second->close();
+    }
+
+    // set from another thread (or a signal handler) to shut the server down
+    atomic<bool> stop{ false };
+
+private:
+    // One client connection. Workers answer through it, so writes are locked, and a closed
+    // connection silently drops the answers of its searches.
+    struct Connection
+    {
+        Connection(const int fd) : fd(fd)
+        {
+        }
+
+        void send(const string& text)
+        {
+            lock_guard<mutex> lock(out_mtx);
+            if (fd == -1)
+                return;
+            const string line = text + "\n";
+            for (size_t sent = 0; sent < line.size();)
+            {
+                const auto n = ::send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+                if (n <= 0)
+                    return;
+                sent += n;
+            }
+        }
+
+        void close()
+        {
+            lock_guard<mutex> lock(out_mtx);
+            if (fd != -1)
+                ::close(fd);
+            fd = -1;
+        }
+
+        int fd;
+        string input;
+        mutex out_mtx;
+    };
+
+    // A game: the position and the positions since the last capture or man move (older ones can't
+    // repeat), so its size stays small and does not grow with the length of the game.
+    struct Session
+    {
+        POS_T cells[Russian::Size][Russian::Size];
+        bool color = 0;
+        int level;
+        int movetime;
+        vector<uint64_t> positions;
+        // a search is queued or running; the session is then owned by the worker
+        bool busy = false;
+        bool closed = false;
+    };
+
+    // A queued search, the earliest deadline is run first and equal deadlines in the order of arrival
+    struct Request
+    {
+        size_t session;
+        chrono::steady_clock::time_point start;
+        chrono::steady_clock::time_point deadline;
+        size_t order;
+        shared_ptr<Connection> conn;
+
+        bool operator<(const Request& other) const
+        {
+            return deadline != other.deadline ? deadline > other.deadline : order > other.order;
+        }
+    };
+
+    // Runs one command, returns false if the connection should be closed
+    bool handle(const shared_ptr<Connection>& conn, const string& line)
+    {
+        stringstream ss(line);
+        string cmd;
+        ss >> cmd;
+        if (cmd.empty())
+            return true;
+        if (cmd == "quit")
+            return false;
+        try
+        {
+            if (cmd == "new")
+                new_session(conn, ss);
+            else if (cmd == "move")
+                move(conn, ss);
+            else if (cmd == "go")
+                go(conn, ss);
+            else if (cmd == "position")
+            {
+                const size_t id = read_id(ss);
+                auto& s = session(id);
+                conn->send("position " + to_string(id) + " " + Fen::to_string(get_mtx(s), s.color));
+            }
+            else if (cmd == "close")
+            {
+                const size_t id = read_id(ss);
+                lock_guard<mutex> lock(mtx);
+                auto it = sessions.find(id);
+                if (it == sessions.end() || it->second->closed)
+                    throw runtime_error("no session " + to_string(id));
+                // a busy session is removed by its worker
+                it->second->closed = true;
+                if (!it->second->busy)
+                    sessions.erase(it);
+                conn->send("ok " + to_string(id));
+            }
+            else if (cmd == "stats")
+                conn->send(stats());
+            else
+                conn->send("error unknown command " + cmd);
+        }
+        catch (const exception& e)
+        {
+            conn->send(string("error ") + e.what());
+        }
+        return true;
+    }
+
+    void new_session(const shared_ptr<Connection>& conn, stringstream& ss)
+    {
+        auto s = make_unique<Session>();
+        s->level = Default_level;
+        s->movetime = Default_movetime_ms;
+        string word, fen = "start";
+        while (ss >> word)
+        {
+            if (word == "level")
+                ss >> s->level;
+            else if (word == "movetime")
+                ss >> s->movetime;
+            else if (word == "fen")
+            {
+                fen.clear();
+                while (ss >> word)
+                    fen += word;
+            }
+            else
+                throw runtime_error("unknown new parameter " + word);
+        }
+        s->level = std::min(std::max(s->level, 0), Max_search_depth);
+        s->movetime = std::max(s->movetime, 1);
+
+        vector<vector<POS_T>> new_mtx;
+        bool new_color;
+        Fen::parse(fen, new_mtx, new_color);
+        set_mtx(*s, new_mtx);
+        s->color = new_color;
+        s->positions.push_back(Zobrist::hash(new_mtx, new_color));
+
+        lock_guard<mutex> lock(mtx);
+        const size_t id = ++last_id;
+        sessions[id] = std::move(s);
+        conn->send("session " + to_string(id));
+    }
+
+    // a turn of the player; checked with the I/O thread's own Logic
+    void move(const shared_ptr<Connection>& conn, stringstream& ss)
+    {
+        const size_t id = read_id(ss);
+        string text;
+        ss >> text;
+        auto& s = session(id);
+        const auto cur = get_mtx(s);
+        for (const auto& turn : io_logic.find_sequences(cur, s.color))
+        {
+            if (Fen::turn_to_string(turn.to_vector()) == text)
+            {
+                conn->send("ok " + to_string(id));
+                const string result = make_turn(io_board, io_logic, s, turn);
+                if (!result.empty())
+                    conn->send("gameover " + to_string(id) + " " + result);
+                return;
+            }
+        }
+        throw runtime_error("illegal turn " + text);
+    }
+
+    void go(const shared_ptr<Connection>& conn, stringstream& ss)
+    {
+        const size_t id = read_id(ss);
+        const auto now = chrono::steady_clock::now();
+        {
+            lock_guard<mutex> lock(mtx);
+            auto& s = session_locked(id);
+            s.busy = true;
+            queue.push({ id, now, now + chrono::milliseconds(s.movetime), ++last_order, conn });
+        }
+        // the task runs whichever search is the most urgent at that moment
+        pool.push([this](const size_t worker) { search(worker); });
+    }
+
+    void search(const size_t worker)
+    {
+        Request req;
+        Session* s;
+        bool closed;
+        {
+            lock_guard<mutex> lock(mtx);
+            req = queue.top();
+            queue.pop();
+            s = sessions[req.session].get();
+            closed = s->closed;
+        }
+        const string id = to_string(req.session);
+
+        // answers are sent after the session is free again, so the client can go on at once
+        vector<string> answers;
+        if (!closed && !stop)
+        {
+            auto& board = *boards[worker];
+            auto& logic = *logics[worker];
+            const auto cur = get_mtx(*s);
+            load_history(board, *s);
+            search_limits limits;
+            limits.depth = s->level;
+            limits.time_ms = int(std::max<long long>(1,
+                chrono::duration_cast<chrono::milliseconds>(req.deadline - chrono::steady_clock::now()).count()));
+            limits.stop = &stop;
+            const auto res = logic.analyze(cur, s->color, 1, limits);
+            if (res.lines.empty())
+            {
+                answers.push_back("bestmove " + id + " none");
+            }
+            else
+            {
+                move_seq seq;
+                for (const auto& hop : res.lines[0].turn)
+                    seq.push_back(hop);
+                answers.push_back("bestmove " + id + " " + Fen::turn_to_string(res.lines[0].turn));
+                const string result = make_turn(board, logic, *s, seq);
+                if (!result.empty())
+                    answers.push_back("gameover " + id + " " + result);
+            }
+        }
+
+        {
+            const double latency = chrono::duration<double, milli>(chrono::steady_clock::now() - req.start).count();
+            lock_guard<mutex> lock(mtx);
+            latencies[searches++ % latencies.size()] = latency;
+            s->busy = false;
+            if (s->closed)
+                sessions.erase(req.session);
+        }
+        for (const auto& answer : answers)
+            req.conn->send(answer);
+    }
+
+    // Makes the turn in the session; returns the result if the game is over, otherwise ""
+    static string make_turn(Board& board, Logic& logic, Session& s, const move_seq& turn)
+    {
+        auto cur = get_mtx(s);
+        const bool reversible = Logic::is_reversible(cur, turn);
+        cur = logic.make_turn(cur, turn);
+        set_mtx(s, cur);
+        s.color = !s.color;
+        if (!reversible)
+            s.positions.clear();
+        s.positions.push_back(Zobrist::hash(cur, s.color));
+
+        load_history(board, s);
+        if (logic.find_sequences(cur, s.color).empty())
+            return s.color ? "white" : "black";
+        if (logic.is_game_drawn())
+            return "draw";
+        return "";
+    }
+
+    // fills the board history with the positions of the session for the draw rules
+    static void load_history(Board& board, const Session& s)
+    {
+        board.history.clear();
+        for (size_t i = 0; i < s.positions.size(); ++i)
+            board.history.push(s.positions[i], i > 0);
+    }
+
+    static vector<vector<POS_T>> get_mtx(const Session& s)
+    {
+        vector<vector<POS_T>> res(Russian::Size, vector<POS_T>(Russian::Size));
+        for (POS_T i = 0; i < Russian::Size; ++i)
+            for (POS_T j = 0; j < Russian::Size; ++j)
+                res[i][j] = s.cells[i][j];
+        return res;
+    }
+
+    static void set_mtx(Session& s, const vector<vector<POS_T>>& mtx)
+    {
+        for (POS_T i = 0; i < Russian::Size; ++i)
+            for (POS_T j = 0; j < Russian::Size; ++j)
+                s.cells[i][j] = mtx[i][j];
+    }
+
+    static size_t read_id(stringstream& ss)
+    {
+        size_t id = 0;
+        if (!(ss >> id))
+            throw runtime_error("session id expected");
+        return id;
+    }
+
+    // the session, if it exists and is not busy; only the I/O thread changes a free session
+    Session& session(const size_t id)
+    {
+        lock_guard<mutex> lock(mtx);
+        return session_locked(id);
+    }
+
+    Session& session_locked(const size_t id)
+    {
+        auto it = sessions.find(id);
+        if (it == sessions.end() || it->second->closed)
+            throw runtime_error("no session " + to_string(id));
+        if (it->second->busy)
+            throw runtime_error("session " + to_string(id) + " is searching");
+        return *it->second;
+    }
+
+    string stats()
+    {
+        lock_guard<mutex> lock(mtx);
+        vector<double> last(latencies.begin(), latencies.begin() + std::min(searches, latencies.size()));
+        auto percentile = [&](const double p) {
+            if (last.empty())
+                return 0.0;
+            auto it = last.begin() + size_t(p * (last.size() - 1));
+            nth_element(last.begin(), it, last.end());
+            return *it;
+        };
+        stringstream res;
+        res << "stats sessions " << sessions.size() << " workers " << pool.size() << " queued " << queue.size()
+            << " searches " << searches << " p50 " << percentile(0.5) << " p99 " << percentile(0.99);
+        return res.str();
+    }
+
+    static const int Default_level = 6;
+    static const int Default_movetime_ms = 1000;
+    static const int Poll_timeout_ms = 200;
+
+    Config* config;
+    int listener = -1;
+
+    // move checks and game end detection on the I/O thread
+    Board io_board;
+    Logic io_logic;
+    // every worker has its own board (for the position history) and Logic
+    vector<unique_ptr<Board>> boards;
+    vector<unique_ptr<Logic>> logics;
+    ThreadPool pool;
+
+    // guards the sessions, the queue and the statistics
+    mutex mtx;
+    unordered_map<size_t, unique_ptr<Session>> sessions;
+    size_t last_id = 0;
+    priority_queue<Request> queue;
+    size_t last_order = 0;
+    size_t searches = 0;
+    // latencies of the last searches in milliseconds, from "go" to the answer
+    array<double, 4096> latencies{};
+};
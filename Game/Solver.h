@@ -0,0 +1,495 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "../Models/Analysis.h"
+#include "Logic.h"
+
+// Exact values of positions of the variant V by depth-first proof-number search (df-pn with the 1 + epsilon
+// thresholds). A position is solved with two proofs: whether the side to move wins, and if not, whether
+// it holds the draw. Each proof searches an AND/OR tree where the side to move at the root is the attacker;
+// a node holds a proof and a disproof number in negamax form (phi for the side to move, delta for the
+// other) in a transposition table shared by all threads.
+//
+// Draws: a position is drawn after DrawQuietTurns turns in a row without captures and man moves, and the
+// number of such turns is a part of the table key. It grows along every line that could repeat, so the
+// graph has no cycles and the values do not depend on the path. Repetitions (DrawRepetitions) are left
+// out: a line repeating positions reaches the quiet turn limit as well, just later.
+//
+// Memory: the table has a fixed size. When it is 90% full, the entries with the smallest subtrees (the
+// nodes searched below them) are removed until it is half full, unproven ones first.
+// Threads: all of them search from the root; the helpers see the nodes other threads are in as harder
+// than they are (their disproof number times the number of such threads), so they go to other subtrees.
+template <class V>
+class BasicSolver
+{
+public:
+    BasicSolver(Config* config, const size_t threads, const size_t memory_mb)
+        : threads(std::max<size_t>(threads, 1)), table(std::max<size_t>(memory_mb * (1 << 20) / sizeof(entry), Bucket_size) / Bucket_size * Bucket_size)
+    {
+        const int rule = (*config)("Game", "DrawQuietTurns");
+        quiet_limit = (rule > 0 ? rule : Default_quiet_turns);
+        std::mt19937_64 gen(20240915);
+        quiet_keys.resize(quiet_limit + 1);
+        for (auto& key : quiet_keys)
+            key = gen();
+        for (auto& key : target_keys)
+            key = gen();
+    }
+
+    // Solves mtx with color to move, quiet_turns turns without captures and man moves having led to it.
+    // A limit reached (depth is not used) leaves the value unknown; the table keeps what was proven.
+    solver_result solve(const vector<vector<POS_T>>& mtx, const bool color, const search_limits& limits,
+        const int quiet_turns = 0)
+    {
+        const auto start = chrono::steady_clock::now();
+        this->limits = limits;
+        deadline = limits.time_ms ? start + chrono::milliseconds(limits.time_ms) : chrono::steady_clock::time_point::max();
+        total_nodes = checked_nodes = 0;
+        solver_result res;
+        if (quiet_turns >= quiet_limit)
+        {
+            res.value = solver_result::Draw;
+        }
+        else if (prove(mtx, color, quiet_turns, Win_target, res.turn))
+        {
+            res.value = solver_result::Win;
+        }
+        else if (!stopped)
+        {
+            res.turn.clear();
+            if (prove(mtx, color, quiet_turns, Draw_target, res.turn))
+                res.value = solver_result::Draw;
+            else if (!stopped)
+                res.value = solver_result::Loss;
+        }
+        if (res.value == solver_result::Unknown || res.value == solver_result::Loss)
+            res.turn.clear();
+        res.nodes = total_nodes;
+        res.time_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        return res;
+    }
+
+    // the quiet turns after which a position is drawn, see above
+    int quiet_turns_limit() const
+    {
+        return quiet_limit;
+    }
+
+    // entries in the table and the garbage collections so far
+    size_t table_used() const
+    {
+        return used;
+    }
+
+    size_t collections() const
+    {
+        return gc_runs;
+    }
+
+private:
+    // proof and disproof numbers: Inf - proven or disproven
+    static const uint32_t Inf = 1u << 30;
+    static const size_t Bucket_size = 8;
+    static const size_t Stripes = 1024;
+    // garbage collection starts at this share of the table and stops at the second one
+    static constexpr double Gc_fill = 0.9;
+    static constexpr double Gc_keep = 0.5;
+    // quiet turn limit when DrawQuietTurns is off, the search needs one
+    static const int Default_quiet_turns = 30;
+
+    // what the attacker has to show: a win, or at least a draw
+    enum Target
+    {
+        Win_target,
+        Draw_target,
+    };
+
+    struct entry
+    {
+        // 0 - free
+        uint64_t key = 0;
+        uint32_t phi = 1, delta = 1;
+        // nodes searched below this one
+        uint64_t work = 0;
+        // threads searching below this one, their entries are not removed
+        uint32_t busy = 0;
+    };
+
+    // A node on the line of a thread: the position, its turns and the keys of the positions after them
+    // (0 - drawn by the quiet turn rule)
+    struct frame
+    {
+        vector<vector<POS_T>> mtx = vector<vector<POS_T>>(V::Size, vector<POS_T>(V::Size));
+        vector<move_seq> turns;
+        vector<uint64_t> keys;
+        vector<int> quiet;
+    };
+
+    struct worker
+    {
+        size_t id = 0;
+        size_t nodes = 0;
+        move_list scratch;
+        vector<vector<POS_T>> child = vector<vector<POS_T>>(V::Size, vector<POS_T>(V::Size));
+        vector<unique_ptr<frame>> frames;
+
+        frame& at(const size_t ply)
+        {
+            while (frames.size() <= ply)
+                frames.push_back(make_unique<frame>());
+            return *frames[ply];
+        }
+    };
+
+    // Proves target for color to move in mtx with all threads; turn gets the proving turn
+    bool prove(const vector<vector<POS_T>>& mtx, const bool color, const int quiet_turns, const Target target,
+        vector<move_pos>& turn)
+    {
+        this->target = target;
+        attacker = color;
+        halt = false;
+        stopped = false;
+        const uint64_t root_key = make_key(mtx, color, quiet_turns);
+        vector<thread> helpers;
+        vector<unique_ptr<worker>> workers;
+        for (size_t i = 0; i < threads; ++i)
+        {
+            workers.push_back(make_unique<worker>());
+            workers.back()->id = i;
+            workers.back()->at(0).mtx = mtx;
+        }
+        for (size_t i = 1; i < threads; ++i)
+            helpers.emplace_back([&, i] { run(*workers[i], color, quiet_turns, root_key); });
+        run(*workers[0], color, quiet_turns, root_key);
+        halt = true;
+        for (auto& helper : helpers)
+            helper.join();
+        for (const auto& w : workers)
+            total_nodes += w->nodes;
+
+        uint32_t phi, delta;
+        lookup(root_key, phi, delta);
+        if (phi != 0)
+            return false;
+        // the turn to a position proven for the attacker
+        auto& root = workers[0]->at(0);
+        expand(*workers[0], root, color, quiet_turns);
+        for (size_t i = 0; i < root.turns.size(); ++i)
+        {
+            child_values(root.keys[i], !color, phi, delta);
+            if (delta == 0)
+            {
+                turn = root.turns[i].to_vector();
+                break;
+            }
+        }
+        return true;
+    }
+
+    void run(worker& w, const bool color, const int quiet_turns, const uint64_t root_key)
+    {
+        uint32_t phi, delta;
+        while (!halt)
+        {
+            lookup(root_key, phi, delta);
+            if (phi == 0 || delta == 0)
+                break;
+            mid(w, 0, color, quiet_turns, root_key, Inf, Inf);
+        }
+        halt = true;
+    }
+
+    // Multiple iterative deepening of df-pn: searches the node of ply until its phi reaches thphi or its
+    // delta reaches thdelta, always in the child with the smallest delta
+    void mid(worker& w, const size_t ply, const bool color, const int quiet, const uint64_t key, const uint32_t thphi,
+        const uint32_t thdelta)
+    {
+        const size_t start_nodes = w.nodes++;
+        if ((w.nodes & Limit_check_period) == 0)
+            check_limits();
+        if (halt)
+            return;
+        auto& node = w.at(ply);
+        if (!expand(w, node, color, quiet))
+        {
+            // no turns: the side to move lost
+            store(key, Inf, 0, 1, 0);
+            return;
+        }
+
+        uint32_t phi = 1, delta = 1;
+        mark(key, 1);
+        while (!halt)
+        {
+            // phi is the smallest delta of the children; delta is their largest phi plus one for every other
+            // child not yet won by the side to move (weak proof numbers: the sum of phi counts a position
+            // reached by many lines many times, and the lines of quiet turns meet all the time)
+            uint64_t largest = 0, open = 0;
+            phi = Inf;
+            size_t best = 0;
+            uint32_t best_phi = 0, best_delta = Inf;
+            uint64_t best_cost = UINT64_MAX, second_cost = UINT64_MAX;
+            for (size_t i = 0; i < node.turns.size(); ++i)
+            {
+                uint32_t child_phi, child_delta, busy;
+                child_values(node.keys[i], !color, child_phi, child_delta, &busy);
+                phi = std::min(phi, child_delta);
+                largest = std::max<uint64_t>(largest, child_phi);
+                open += (child_phi != 0);
+                // a helper thread avoids the children other threads are in
+                uint64_t cost = child_delta;
+                if (w.id && busy && child_delta < thphi)
+                    cost *= 1 + busy;
+                if (cost < best_cost)
+                {
+                    second_cost = best_cost;
+                    best_cost = cost;
+                    best = i;
+                    best_phi = child_phi;
+                    best_delta = child_delta;
+                }
+                else if (cost < second_cost)
+                {
+                    second_cost = cost;
+                }
+            }
+            delta = uint32_t(largest >= Inf ? Inf : std::min<uint64_t>(largest + (open ? open - 1 : 0), Inf - 1));
+            if (phi >= thphi || delta >= thdelta)
+                break;
+
+            const int64_t child_thphi = int64_t(thdelta) - int64_t(delta) + best_phi;
+            const uint64_t second = std::min<uint64_t>(second_cost, Inf);
+            const uint64_t child_thdelta = std::max<uint64_t>(std::min<uint64_t>(thphi, second + second / 4 + 1), best_delta + 1);
+            auto& next = w.at(ply + 1);
+            next.mtx = node.mtx;
+            BasicLogic<V>::apply_turn(next.mtx, node.turns[best]);
+            mid(w, ply + 1, !color, node.quiet[best], node.keys[best], uint32_t(std::min<int64_t>(child_thphi, Inf)),
+                uint32_t(std::min<uint64_t>(child_thdelta, Inf)));
+        }
+        store(key, phi, delta, w.nodes - start_nodes, -1);
+    }
+
+    // Fills the turns of the node and the keys after them; false if there are no turns
+    bool expand(worker& w, frame& node, const bool color, const int quiet)
+    {
+        BasicLogic<V>::generate_sequences(node.mtx, color, false, w.scratch);
+        node.turns.assign(w.scratch.begin(), w.scratch.end());
+        node.keys.resize(node.turns.size());
+        node.quiet.resize(node.turns.size());
+        for (size_t i = 0; i < node.turns.size(); ++i)
+        {
+            const auto& seq = node.turns[i];
+            node.quiet[i] = BasicLogic<V>::is_reversible(node.mtx, seq) ? quiet + 1 : 0;
+            if (node.quiet[i] >= quiet_limit)
+            {
+                node.keys[i] = 0;
+                continue;
+            }
+            w.child = node.mtx;
+            BasicLogic<V>::apply_turn(w.child, seq);
+            node.keys[i] = make_key(w.child, !color, node.quiet[i]);
+        }
+        return !node.turns.empty();
+    }
+
+    // Values of the position with key and color to move; key 0 is a draw by the quiet turn rule
+    void child_values(const uint64_t key, const bool color, uint32_t& phi, uint32_t& delta, uint32_t* busy = nullptr)
+    {
+        if (busy)
+            *busy = 0;
+        if (key)
+        {
+            lookup(key, phi, delta, busy);
+            return;
+        }
+        // a draw is the attacker's goal when proving a draw, the defender's one when proving a win
+        const bool reached = ((color == attacker) == (target == Draw_target));
+        phi = reached ? 0 : Inf;
+        delta = reached ? Inf : 0;
+    }
+
+    uint64_t make_key(const vector<vector<POS_T>>& mtx, const bool color, const int quiet) const
+    {
+        return (Zobrist::hash(mtx, color) ^ quiet_keys[quiet] ^ target_keys[target * 2 + attacker]) | 1;
+    }
+
+    // every thread calls it once per Limit_check_period + 1 of its nodes
+    void check_limits()
+    {
+        const size_t nodes = (checked_nodes += Limit_check_period + 1);
+        if ((limits.stop && *limits.stop) || (limits.nodes && nodes >= limits.nodes) ||
+            chrono::steady_clock::now() >= deadline)
+        {
+            stopped = true;
+            halt = true;
+        }
+    }
+
+    // table of buckets of Bucket_size entries, each bucket guarded by one of the stripe mutexes;
+    // the garbage collection takes the whole table
+    size_t bucket(const uint64_t key) const
+    {
+        return size_t((key >> 20) % (table.size() / Bucket_size)) * Bucket_size;
+    }
+
+    // unknown nodes have phi = delta = 1
+    void lookup(const uint64_t key, uint32_t& phi, uint32_t& delta, uint32_t* busy = nullptr)
+    {
+        std::shared_lock<std::shared_mutex> gc_lock(gc_mtx);
+        const size_t b = bucket(key);
+        std::lock_guard<std::mutex> lock(stripes[(b / Bucket_size) % Stripes]);
+        for (size_t i = b; i < b + Bucket_size; ++i)
+        {
+            if (table[i].key == key)
+            {
+                phi = table[i].phi;
+                delta = table[i].delta;
+                if (busy)
+                    *busy = table[i].busy;
+                return;
+            }
+        }
+        phi = delta = 1;
+    }
+
+    void store(const uint64_t key, const uint32_t phi, const uint32_t delta, const uint64_t work, const int busy)
+    {
+        update(key, [&](entry& e) {
+            // a proof found by another thread meanwhile stays
+            if (e.phi != 0 && e.delta != 0)
+            {
+                e.phi = phi;
+                e.delta = delta;
+            }
+            e.work += work;
+            e.busy = uint32_t(std::max<int>(int(e.busy) + busy, 0));
+        });
+    }
+
+    void mark(const uint64_t key, const int busy)
+    {
+        update(key, [&](entry& e) { e.busy = uint32_t(std::max<int>(int(e.busy) + busy, 0)); });
+    }
+
+    // Applies f to the entry of key, made if there is none: in a free slot, or instead of the entry of the
+    // bucket with the smallest subtree that is not busy, unproven ones first. Nothing if all are busy.
+    template <class F> void update(const uint64_t key, F&& f)
+    {
+        {
+            std::shared_lock<std::shared_mutex> gc_lock(gc_mtx);
+            const size_t b = bucket(key);
+            std::lock_guard<std::mutex> lock(stripes[(b / Bucket_size) % Stripes]);
+            entry* victim = nullptr;
+            for (size_t i = b; i < b + Bucket_size; ++i)
+            {
+                auto& e = table[i];
+                if (e.key == key)
+                {
+                    f(e);
+                    return;
+                }
+                if (!e.key)
+                {
+                    if (!victim || victim->key)
+                        victim = &e;
+                }
+                else if (!e.busy && (!victim || (victim->key && worse(e, *victim))))
+                {
+                    victim = &e;
+                }
+            }
+            if (!victim)
+                return;
+            if (!victim->key)
+                ++used;
+            *victim = entry();
+            victim->key = key;
+            f(*victim);
+        }
+        if (used >= Gc_fill * table.size())
+            collect();
+    }
+
+    // whether a is to be removed before b
+    static bool worse(const entry& a, const entry& b)
+    {
+        const bool a_proven = (a.phi == 0 || a.delta == 0), b_proven = (b.phi == 0 || b.delta == 0);
+        return a_proven != b_proven ? !a_proven : a.work < b.work;
+    }
+
+    // Removes the entries with the smallest subtrees, unproven ones first, until the table is Gc_keep full
+    void collect()
+    {
+        std::unique_lock<std::shared_mutex> gc_lock(gc_mtx);
+        if (used < Gc_fill * table.size())
+            return;
+        // entries by proven and by the bit length of work
+        array<array<size_t, 65>, 2> count{};
+        for (const auto& e : table)
+        {
+            if (e.key && !e.busy)
+                ++count[e.phi == 0 || e.delta == 0][bit_length(e.work)];
+        }
+        const size_t to_free = used - size_t(Gc_keep * table.size());
+        size_t freed = 0;
+        int limit[2] = { -1, -1 };
+        for (int proven = 0; proven < 2 && freed < to_free; ++proven)
+        {
+            for (int bits = 0; bits <= 64 && freed < to_free; ++bits)
+            {
+                freed += count[proven][bits];
+                limit[proven] = bits;
+            }
+        }
+        for (auto& e : table)
+        {
+            if (e.key && !e.busy && bit_length(e.work) <= limit[e.phi == 0 || e.delta == 0])
+            {
+                e = entry();
+                --used;
+            }
+        }
+        ++gc_runs;
+    }
+
+    static int bit_length(uint64_t value)
+    {
+        int res = 0;
+        for (; value; value >>= 1)
+            ++res;
+        return res;
+    }
+
+    size_t threads;
+    int quiet_limit;
+    vector<uint64_t> quiet_keys;
+    array<uint64_t, 4> target_keys;
+    vector<entry> table;
+    array<std::mutex, Stripes> stripes;
+    std::shared_mutex gc_mtx;
+    atomic<size_t> used{ 0 };
+    atomic<size_t> gc_runs{ 0 };
+
+    // the proof in progress
+    Target target = Win_target;
+    bool attacker = false;
+    search_limits limits;
+    chrono::steady_clock::time_point deadline;
+    size_t total_nodes = 0;
+    // nodes of all threads as check_limits counts them
+    atomic<size_t> checked_nodes{ 0 };
+    // halt - the threads unwind: the root is proven or a limit is reached (stopped)
+    atomic<bool> halt{ false };
+    atomic<bool> stopped{ false };
+};
+
+typedef BasicSolver<Russian> Solver;
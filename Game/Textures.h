@@ -0,0 +1,306 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __APPLE__
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#else
+#include <SDL.h>
+#include <SDL_image.h>
+#endif
+
+#include "Trace.h"
+
+// Pictures of the window at start: the board and one atlas with the pieces and the buttons.
+// Decoding starts on worker threads as soon as the loader is made, so it goes on while SDL, the window
+// and the renderer come up. With the cache the decoded pixels of both are read from one file
+// (Textures/textures.cache, rewritten when a picture changes) instead of decoding the PNGs.
+class TextureLoader
+{
+public:
+    // pictures in the atlas
+    enum Sprite
+    {
+        White_man,
+        Black_man,
+        White_queen,
+        Black_queen,
+        Back_button,
+        Replay_button,
+        Sprites
+    };
+
+    TextureLoader(const std::string& textures_path, const bool use_cache)
+        : cache_path(textures_path + "textures.cache"), use_cache(use_cache)
+    {
+        sources = { textures_path + "board.png",       textures_path + "piece_white.png",
+                    textures_path + "piece_black.png", textures_path + "queen_white.png",
+                    textures_path + "queen_black.png", textures_path + "back.png",
+                    textures_path + "replay.png" };
+        // the decoders are set up here, once, and not by the first IMG_Load of the workers at the same time
+        IMG_Init(IMG_INIT_PNG);
+        pending = std::async(std::launch::async, [this] { return load(); });
+    }
+
+    ~TextureLoader()
+    {
+        if (pending.valid())
+            pending.wait();
+        if (cache_writer.joinable())
+            cache_writer.join();
+    }
+
+    // Waits for the pictures and makes the board and atlas textures; false if a picture can't be loaded.
+    // The rects of the sprites in the atlas go to sprites.
+    bool make_textures(SDL_Renderer* ren, SDL_Texture*& board, SDL_Texture*& atlas, SDL_Rect sprites[Sprites])
+    {
+        const auto start = std::chrono::steady_clock::now();
+        pictures pics;
+        {
+            Trace::Span span("wait_decoding");
+            pics = pending.get();
+        }
+        wait_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        from_cache = pics.from_cache;
+        if (!pics.error.empty())
+        {
+            error = pics.error;
+            return false;
+        }
+
+        Trace::Span span("upload_textures");
+        board = make_texture(ren, pics.board);
+        atlas = make_texture(ren, pics.atlas);
+        for (int i = 0; i < Sprites; ++i)
+            sprites[i] = pics.sprites[i];
+        if (!board || !atlas)
+        {
+            error = "can't create textures";
+            return false;
+        }
+        // the next start reads them at once; the pixels are not needed here any more
+        if (use_cache && !pics.from_cache)
+            cache_writer = std::thread([this, p = std::move(pics)] { write_cache(p); });
+        return true;
+    }
+
+    // whether the pictures came from the cache and how long make_textures waited for them
+    bool from_cache = false;
+    double wait_ms = 0;
+    std::string error;
+
+private:
+    // RGBA pixels, rows without gaps
+    struct image
+    {
+        int w = 0, h = 0;
+        std::vector<uint8_t> pixels;
+    };
+
+    struct pictures
+    {
+        image board, atlas;
+        SDL_Rect sprites[Sprites]{};
+        bool from_cache = false;
+        std::string error;
+    };
+
+    // size and modification time of a source file: the cache is valid while they are the same
+    struct stamp
+    {
+        int64_t size = -1;
+        int64_t time = 0;
+
+        bool operator==(const stamp& other) const
+        {
+            return size == other.size && time == other.time;
+        }
+    };
+
+    // widest row of the atlas in pixels
+    static const int Atlas_width = 2048;
+    static constexpr char Cache_magic[8] = { 'C', 'K', 'T', 'E', 'X', 'C', '0', '1' };
+
+    pictures load()
+    {
+        Trace::name_thread("texture loader");
+        Trace::Span span("load_pictures");
+        pictures res;
+        if (use_cache && read_cache(res))
+        {
+            res.from_cache = true;
+            return res;
+        }
+
+        // every picture on its own thread, then the sprites are packed into the atlas
+        std::vector<std::future<image>> decoded;
+        for (const auto& path : sources)
+            decoded.push_back(std::async(std::launch::async, [path] { return decode(path); }));
+        std::vector<image> images;
+        for (size_t i = 0; i < decoded.size(); ++i)
+        {
+            images.push_back(decoded[i].get());
+            if (images.back().pixels.empty())
+                res.error = "can't load " + sources[i];
+        }
+        if (!res.error.empty())
+            return res;
+
+        res.board = std::move(images[0]);
+        pack(images.begin() + 1, res);
+        return res;
+    }
+
+    static image decode(const std::string& path)
+    {
+        Trace::Span span("decode_png");
+        image res;
+        SDL_Surface* loaded = IMG_Load(path.c_str());
+        if (!loaded)
+            return res;
+        SDL_Surface* rgba = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+        SDL_FreeSurface(loaded);
+        if (!rgba)
+            return res;
+        res.w = rgba->w;
+        res.h = rgba->h;
+        res.pixels.resize(size_t(res.w) * res.h * 4);
+        for (int y = 0; y < res.h; ++y)
+            memcpy(&res.pixels[size_t(y) * res.w * 4], static_cast<uint8_t*>(rgba->pixels) + size_t(y) * rgba->pitch,
+                   size_t(res.w) * 4);
+        SDL_FreeSurface(rgba);
+        return res;
+    }
+
+    // places the sprites in rows left to right, a row is as high as its highest sprite
+    static void pack(std::vector<image>::const_iterator sprites, pictures& res)
+    {
+        int x = 0, y = 0, row_h = 0, w = 0;
+        for (int i = 0; i < Sprites; ++i)
+        {
+            const auto& s = sprites[i];
+            if (x > 0 && x + s.w > Atlas_width)
+            {
+                y += row_h;
+                x = row_h = 0;
+            }
+            res.sprites[i] = { x, y, s.w, s.h };
+            x += s.w;
+            w = std::max(w, x);
+            row_h = std::max(row_h, s.h);
+        }
+        res.atlas.w = w;
+        res.atlas.h = y + row_h;
+        res.atlas.pixels.assign(size_t(res.atlas.w) * res.atlas.h * 4, 0);
+        for (int i = 0; i < Sprites; ++i)
+        {
+            const auto& s = sprites[i];
+            const auto& r = res.sprites[i];
+            for (int row = 0; row < s.h; ++row)
+                memcpy(&res.atlas.pixels[(size_t(r.y + row) * res.atlas.w + r.x) * 4], &s.pixels[size_t(row) * s.w * 4],
+                       size_t(s.w) * 4);
+        }
+    }
+
+    static SDL_Texture* make_texture(SDL_Renderer* ren, const image& img)
+    {
+        SDL_Texture* res = SDL_CreateTexture(ren, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, img.w, img.h);
+        if (!res)
+            return nullptr;
+        SDL_UpdateTexture(res, nullptr, img.pixels.data(), img.w * 4);
+        SDL_SetTextureBlendMode(res, SDL_BLENDMODE_BLEND);
+        return res;
+    }
+
+    std::vector<stamp> stamps() const
+    {
+        std::vector<stamp> res;
+        for (const auto& path : sources)
+        {
+            std::error_code ec;
+            stamp s;
+            const auto size = std::filesystem::file_size(path, ec);
+            if (!ec)
+                s.size = int64_t(size);
+            const auto time = std::filesystem::last_write_time(path, ec);
+            if (!ec)
+                s.time = int64_t(time.time_since_epoch().count());
+            res.push_back(s);
+        }
+        return res;
+    }
+
+    // Cache file: the magic, the stamps of the sources, the sprite rects, then the board and the atlas
+    // (width, height, pixels)
+    bool read_cache(pictures& res) const
+    {
+        Trace::Span span("read_cache");
+        std::ifstream fin(cache_path, std::ios::binary);
+        char magic[sizeof(Cache_magic)];
+        if (!fin.read(magic, sizeof(magic)) || memcmp(magic, Cache_magic, sizeof(magic)) != 0)
+            return false;
+        for (const auto& s : stamps())
+        {
+            stamp cached;
+            if (!fin.read(reinterpret_cast<char*>(&cached), sizeof(cached)) || !(cached == s) || s.size < 0)
+                return false;
+        }
+        fin.read(reinterpret_cast<char*>(res.sprites), sizeof(res.sprites));
+        return read_image(fin, res.board) && read_image(fin, res.atlas);
+    }
+
+    static bool read_image(std::ifstream& fin, image& img)
+    {
+        int32_t size[2];
+        if (!fin.read(reinterpret_cast<char*>(size), sizeof(size)) || size[0] <= 0 || size[1] <= 0 ||
+            size[0] > 1 << 14 || size[1] > 1 << 14)
+            return false;
+        img.w = size[0];
+        img.h = size[1];
+        img.pixels.resize(size_t(img.w) * img.h * 4);
+        return bool(fin.read(reinterpret_cast<char*>(img.pixels.data()), img.pixels.size()));
+    }
+
+    void write_cache(const pictures& pics) const
+    {
+        Trace::name_thread("texture cache");
+        Trace::Span span("write_cache");
+        // written aside and renamed, so a start at the same time never reads half of it
+        const std::string tmp_path = cache_path + ".tmp";
+        {
+            std::ofstream fout(tmp_path, std::ios::binary | std::ios::trunc);
+            fout.write(Cache_magic, sizeof(Cache_magic));
+            for (const auto& s : stamps())
+                fout.write(reinterpret_cast<const char*>(&s), sizeof(s));
+            fout.write(reinterpret_cast<const char*>(pics.sprites), sizeof(pics.sprites));
+            for (const image* img : { &pics.board, &pics.atlas })
+            {
+                const int32_t size[2] = { img->w, img->h };
+                fout.write(reinterpret_cast<const char*>(size), sizeof(size));
+                fout.write(reinterpret_cast<const char*>(img->pixels.data()), img->pixels.size());
+            }
+            if (!fout)
+            {
+                fout.close();
+                std::remove(tmp_path.c_str());
+                return;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp_path, cache_path, ec);
+    }
+
+    std::string cache_path;
+    bool use_cache;
+    // the board, then the sprites in the order of Sprite
+    std::vector<std::string> sources;
+    std::future<pictures> pending;
+    std::thread cache_writer;
+};
@@ -0,0 +1,86 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running queued tasks. A task gets the index of the worker
+// that runs it, so workers can keep their own Logic instances.
+class ThreadPool
+{
+public:
+    // max_queue - push() blocks while this many tasks are waiting (0 - unbounded)
+    ThreadPool(const size_t threads, const size_t max_queue = 0) : max_queue(max_queue)
+    {
+        for (size_t i = 0; i < threads; ++i)
+        {
+            workers.emplace_back([this, i] { run(i); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            done = true;
+        }
+        task_cv.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    void push(std::function<void(size_t)> task)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        space_cv.wait(lock, [this] { return !max_queue || tasks.size() < max_queue; });
+        tasks.push_back(std::move(task));
+        task_cv.notify_one();
+    }
+
+    // waits until all pushed tasks are finished
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        idle_cv.wait(lock, [this] { return tasks.empty() && !active; });
+    }
+
+    size_t size() const
+    {
+        return workers.size();
+    }
+
+private:
+    void run(const size_t worker)
+    {
+        while (true)
+        {
+            std::function<void(size_t)> task;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                task_cv.wait(lock, [this] { return done || !tasks.empty(); });
+                if (tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                ++active;
+            }
+            space_cv.notify_one();
+            task(worker);
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                --active;
+            }
+            idle_cv.notify_all();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void(size_t)>> tasks;
+    std::mutex mtx;
+    std::condition_variable task_cv, space_cv, idle_cv;
+    size_t max_queue;
+    size_t active = 0;
+    bool done = false;
+};
@@ -0,0 +1,182 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Timeline of the game phases for trace viewers (chrome://tracing, ui.perfetto.dev).
+// A Trace::Span records the time from its construction to its destruction into a ring buffer
+// of the current thread; save() writes the spans of all threads in the Chrome trace event format.
+// While tracing is off a span costs one relaxed atomic load and nothing is recorded.
+class Trace
+{
+public:
+    class Span
+    {
+    public:
+        // name must be a string literal (it is stored as a pointer)
+        explicit Span(const char* name)
+        {
+            if (enabled())
+            {
+                this->name = name;
+                start = now();
+            }
+        }
+
+        ~Span()
+        {
+            if (name)
+                record(name, start, now());
+        }
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+    private:
+        const char* name = nullptr;
+        int64_t start = 0;
+    };
+
+    static void enable(const bool on)
+    {
+        flag().store(on, std::memory_order_relaxed);
+    }
+
+    static bool enabled()
+    {
+        return flag().load(std::memory_order_relaxed);
+    }
+
+    // name of the current thread in the viewer; threads of the same name (one after another,
+    // like the bot delay threads) share a row
+    static void name_thread(const std::string& name)
+    {
+        if (!enabled())
+            return;
+        auto& buf = buffer();
+        std::lock_guard<std::mutex> lock(registry().mtx);
+        buf.name = name;
+        for (const auto& other : registry().buffers)
+        {
+            if (other.get() != &buf && other->name == name)
+            {
+                buf.tid = other->tid;
+                break;
+            }
+        }
+    }
+
+    // Writes the recorded spans of all threads to path. Every other thread that records must be stopped
+    // (joined) before: their buffers are read without synchronization.
+    static bool save(const std::string& path)
+    {
+        std::ofstream fout(path, std::ios_base::trunc);
+        if (!fout)
+            return false;
+        fout << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        std::lock_guard<std::mutex> lock(registry().mtx);
+        const auto& buffers = registry().buffers;
+        for (size_t b = 0; b < buffers.size(); ++b)
+        {
+            const auto& buf = *buffers[b];
+            // a thread sharing the row of an earlier one is named by it
+            if (buf.tid == int(b) + 1)
+            {
+                fout << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buf.tid
+                     << ",\"args\":{\"name\":\"" << buf.name << "\"}}";
+                first = false;
+            }
+            // the oldest span is at the write position once the ring is full
+            const size_t n = buf.events.size();
+            for (size_t i = 0; i < n; ++i)
+            {
+                const auto& e = buf.events[(buf.next + i) % n];
+                fout << (first ? "" : ",") << "\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buf.tid
+                     << std::fixed << std::setprecision(3) << ",\"ts\":" << e.start / 1000.0
+                     << ",\"dur\":" << (e.end - e.start) / 1000.0 << "}";
+                first = false;
+            }
+        }
+        fout << "\n]}\n";
+        return bool(fout);
+    }
+
+private:
+    struct Event
+    {
+        const char* name;
+        // nanoseconds since the start of the program
+        int64_t start, end;
+    };
+
+    // spans of one thread; kept after the thread ends, until save
+    struct Buffer
+    {
+        std::vector<Event> events;
+        // where the next span goes once the ring is full
+        size_t next = 0;
+        int tid = 0;
+        std::string name;
+    };
+
+    struct Registry
+    {
+        std::mutex mtx;
+        std::vector<std::shared_ptr<Buffer>> buffers;
+    };
+
+    // spans per thread, older ones are overwritten
+    static const size_t Buffer_size = 1 << 16;
+
+    static std::atomic<bool>& flag()
+    {
+        static std::atomic<bool> on{ false };
+        return on;
+    }
+
+    static Registry& registry()
+    {
+        static Registry reg;
+        return reg;
+    }
+
+    static int64_t now()
+    {
+        static const auto epoch = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    // buffer of the current thread, registered on the first use
+    static Buffer& buffer()
+    {
+        thread_local std::shared_ptr<Buffer> buf;
+        if (!buf)
+        {
+            buf = std::make_shared<Buffer>();
+            std::lock_guard<std::mutex> lock(registry().mtx);
+            buf->tid = int(registry().buffers.size()) + 1;
+            buf->name = "thread " + std::to_string(buf->tid);
+            registry().buffers.push_back(buf);
+        }
+        return *buf;
+    }
+
+    static void record(const char* name, const int64_t start, const int64_t end)
+    {
+        auto& buf = buffer();
+        if (buf.events.size() < Buffer_size)
+        {
+            buf.events.push_back({ name, start, end });
+            return;
+        }
+        buf.events[buf.next] = { name, start, end };
+        buf.next = (buf.next + 1) % Buffer_size;
+    }
+};
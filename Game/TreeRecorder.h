@@ -0,0 +1,178 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Records search trees of Logic as a compact binary stream for offline analysis (Tools/tree).
+// A search is recorded whole or not at all: begin_search picks searches with the sample rate, so
+// the trees stay complete while the cost is paid for a part of them only. Once the file would grow
+// over the size cap, a truncation mark is written and nothing more is recorded.
+//
+// Stream (native byte order, no padding):
+//     file:    "CKTREE01", uint8 board size
+//     search:  'S', uint8 color, uint8 level, uint32 search id, then the nodes, then 'E', uint64 nodes
+//     enter:   'N', uint8 ply, uint8 plies left, uint8 from cell, uint8 to cell, uint8 hops of a capture
+//              (0 - quiet turn), float alpha, float beta; the cells (x * size + y) are of the turn that
+//              led to the node, the root node of every iteration has none (255)
+//     exit:    'X', uint8 ply, uint8 legal turns, uint8 turns searched, uint8 flags, float score
+//     'T' - truncated, the rest is lost
+// Nodes nest: the nodes entered between the enter and the exit of a node are its children. A move
+// searched twice (a null window search and its re-search) gives two children.
+class TreeRecorder
+{
+public:
+    enum Flags : uint8_t
+    {
+        // leaf of the search, scored by the evaluation
+        Leaf = 1,
+        // a turn failed high and the other turns were not searched
+        Cutoff = 2,
+        // cut by ProbCut before its turns were generated
+        Probcut = 4,
+        // the search was stopped by a limit and unwound
+        Stopped = 8,
+        // answered by the search cache before its turns were generated
+        Cached = 16,
+    };
+
+    static constexpr char Magic[8] = { 'C', 'K', 'T', 'R', 'E', 'E', '0', '1' };
+    static const uint8_t No_cell = 255;
+
+    // sample - share of the searches recorded (0..1), max_bytes - size cap of the file
+    TreeRecorder(const std::string& path, const int board_size, const double sample, const uint64_t max_bytes)
+        : fout(path, std::ios::binary | std::ios::trunc), sample(sample), max_bytes(max_bytes), rand_eng(1)
+    {
+        buffer.reserve(Flush_size + 64);
+        fout.write(Magic, sizeof(Magic));
+        const uint8_t size = uint8_t(board_size);
+        fout.write(reinterpret_cast<const char*>(&size), 1);
+        written = sizeof(Magic) + 1;
+        full = !fout;
+    }
+
+    ~TreeRecorder()
+    {
+        flush();
+    }
+
+    TreeRecorder(const TreeRecorder&) = delete;
+    TreeRecorder& operator=(const TreeRecorder&) = delete;
+
+    // Starts a search of color at level; false if it is not sampled (or the file is full)
+    bool begin_search(const bool color, const int level)
+    {
+        ++searches;
+        if (full || std::uniform_real_distribution<double>(0, 1)(rand_eng) >= sample)
+            return false;
+        put('S');
+        put(uint8_t(color));
+        put(uint8_t(level));
+        put(uint32_t(searches - 1));
+        return true;
+    }
+
+    void end_search(const uint64_t nodes)
+    {
+        if (full)
+            return;
+        put('E');
+        put(nodes);
+        flush();
+    }
+
+    // the turn from the node at ply - 1 to the one at ply
+    void set_move(const size_t ply, const uint8_t from, const uint8_t to, const uint8_t hops)
+    {
+        if (ply < Max_plies)
+            moves[ply] = { from, to, hops };
+    }
+
+    void enter(const size_t ply, const size_t plies_left, const double alpha, const double beta)
+    {
+        if (full)
+            return;
+        const move m = (ply && ply < Max_plies) ? moves[ply] : move();
+        put('N');
+        put(uint8_t(ply));
+        put(uint8_t(plies_left));
+        put(m.from);
+        put(m.to);
+        put(m.hops);
+        put(float(alpha));
+        put(float(beta));
+        check_size();
+    }
+
+    void exit(const size_t ply, const size_t legal, const size_t searched, const uint8_t flags, const double score)
+    {
+        if (full)
+            return;
+        put('X');
+        put(uint8_t(ply));
+        put(uint8_t(std::min<size_t>(legal, 255)));
+        put(uint8_t(std::min<size_t>(searched, 255)));
+        put(flags);
+        put(float(score));
+        check_size();
+    }
+
+    bool is_full() const
+    {
+        return full;
+    }
+
+private:
+    struct move
+    {
+        uint8_t from = No_cell, to = No_cell, hops = 0;
+    };
+
+    static const size_t Flush_size = 1 << 16;
+    static const size_t Max_plies = 256;
+
+    template <class T> void put(const T value)
+    {
+        const size_t at = buffer.size();
+        buffer.resize(at + sizeof(T));
+        memcpy(buffer.data() + at, &value, sizeof(T));
+    }
+
+    void check_size()
+    {
+        if (written + buffer.size() + 1 >= max_bytes)
+        {
+            buffer.push_back('T');
+            flush();
+            full = true;
+        }
+        else if (buffer.size() >= Flush_size)
+        {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        if (buffer.empty())
+            return;
+        fout.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        fout.flush();
+        written += buffer.size();
+        buffer.clear();
+        if (!fout)
+            full = true;
+    }
+
+    std::ofstream fout;
+    double sample;
+    uint64_t max_bytes;
+    uint64_t written = 0;
+    uint64_t searches = 0;
+    bool full = false;
+    std::vector<uint8_t> buffer;
+    move moves[Max_plies];
+    std::mt19937 rand_eng;
+};
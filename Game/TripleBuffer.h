@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Lock-free hand-over of the latest value from one writer thread to one reader thread. The writer fills
+// back() and publishes it; the reader takes the newest published value with update() and reads front().
+// Neither side ever waits for the other: the third slot holds the value between them, and a value
+// published before the reader took the previous one is replaced (the reader only needs the latest).
+template <class T>
+class TripleBuffer
+{
+public:
+    // slot of the writer; it still holds an older value, so the writer sets all of it
+    T& back()
+    {
+        return slots[back_index];
+    }
+
+    void publish()
+    {
+        back_index = middle.exchange(uint8_t(back_index | Fresh), std::memory_order_acq_rel) & Index_mask;
+    }
+
+    // true if a value newer than front() was taken
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & Fresh))
+            return false;
+        front_index = middle.exchange(front_index, std::memory_order_acq_rel) & Index_mask;
+        return true;
+    }
+
+    // slot of the reader
+    const T& front() const
+    {
+        return slots[front_index];
+    }
+
+private:
+    static const uint8_t Index_mask = 3;
+    // the value in the middle slot is not taken by the reader yet
+    static const uint8_t Fresh = 4;
+
+    T slots[3];
+    uint8_t back_index = 0;
+    uint8_t front_index = 1;
+    std::atomic<uint8_t> middle{ 2 };
+};
@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <vector>
+
+#include "Move.h"
+
+// One line of a multi-PV analysis
+struct analysis_line
+{
+    // full turn of the side to move, all hops of a capture series
+    std::vector<move_pos> turn;
+    // score from the point of view of the side to move: logarithm of the material ratio,
+    // 0 - equal or draw, +-1e9 - win or loss
+    double score = 0;
+    // principal variation starting with the turn itself
+    std::vector<move_pos> pv;
+};
+
+// Limits of Logic::analyze, 0 - no limit
+struct search_limits
+{
+    // same meaning as Max_depth
+    int depth = 0;
+    int time_ms = 0;
+    size_t nodes = 0;
+    // the search stops soon after it becomes true
+    const std::atomic<bool>* stop = nullptr;
+};
+
+// Result of Logic::analyze
+struct analysis_result
+{
+    // best lines first
+    std::vector<analysis_line> lines;
+    // last finished iteration, -1 if there are no turns
+    int depth = -1;
+    size_t nodes = 0;
+};
+
+// ProbCut pair of search depths (see Logic::probcut_cut): the score of a search with `deep` plies left
+// is predicted from the one with `shallow` plies left as a * score + b, sigma is the standard deviation
+// of the prediction error
+struct probcut_pair
+{
+    size_t deep = 0;
+    size_t shallow = 0;
+    double a = 1, b = 0, sigma = 0;
+};
+
+// Result of Solver::solve: the value of the position for the side to move under the game rules
+struct solver_result
+{
+    enum Value : int8_t
+    {
+        Loss = -1,
+        Draw = 0,
+        Win = 1,
+        // a limit was reached before the position was proven
+        Unknown = 2,
+    };
+    Value value = Unknown;
+    // a turn keeping the value: the winning one or one holding the draw; empty for a loss or unknown
+    std::vector<move_pos> turn;
+    size_t nodes = 0;
+    double time_ms = 0;
+};
+
+// A position proven by Tools/solve, as Logic uses it in the search: the value for the side to move
+// holds when at most quiet_turns turns without captures and man moves led to it (a win or a loss then
+// also holds after fewer of them, a draw only after exactly as many)
+struct solved_position
+{
+    int8_t value = 0;
+    int quiet_turns = 0;
+};
+
+// A finished search of a root position, as Logic::root_results keeps it
+struct root_result
+{
+    // principal variation, the chosen turn first
+    std::vector<move_seq> pv;
+    // score of the turn from the point of view of the side to move
+    double score = 0;
+    // the search depth (Max_depth) it was found with, -1 - none
+    int depth = -1;
+};
@@ -0,0 +1,33 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "Move.h"
+
+// A hop shown as a slide: the piece goes from (x, y) to (x2, y2) during ms milliseconds from start.
+// piece is its type before the hop, captured - the type of the checker captured on (xb, yb).
+struct animated_hop
+{
+    move_pos hop;
+    POS_T piece = 0;
+    POS_T captured = 0;
+    std::chrono::steady_clock::time_point start;
+    double ms = 0;
+};
+
+// What the window shows, made by the game thread and drawn by the renderer (see Renderer.h):
+// the position after all the hops made so far, the hops still sliding, in the order they are played,
+// and the marks of the player's turn
+struct board_frame
+{
+    // 1 - white, 2 - black, 3 - white queen, 4 - black queen
+    std::vector<std::vector<POS_T>> mtx;
+    std::vector<std::vector<bool>> highlighted;
+    int active_x = -1, active_y = -1;
+    // -1 - the game goes on, 0 - draw, 1 - white wins, 2 - black wins
+    int game_results = -1;
+    std::vector<animated_hop> hops;
+    // grows with every published frame
+    uint64_t version = 0;
+};
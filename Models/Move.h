@@ -1,5 +1,8 @@
 #pragma once
+#include <stdint.h>
 #include <stdlib.h>
+#include <stdexcept>
+#include <vector>
 
 // POS_T type is used to store board cell coordinates
 // It is an 8-bit signed integer (int8_t)
@@ -12,6 +15,11 @@ struct move_pos
     POS_T x2, y2;           // Ending position (to) - cell coordinates
     POS_T xb = -1, yb = -1; // Coordinates of the beaten checker (captured piece), default -1 means no piece beaten
 
+    // Empty move, all coordinates are -1
+    move_pos() : x(-1), y(-1), x2(-1), y2(-1)
+    {
+    }
+
     // Constructor for a move without capturing a piece
     // Takes starting and ending coordinates
     move_pos(const POS_T x, const POS_T y, const POS_T x2, const POS_T y2)
@@ -26,4 +34,141 @@ struct move_pos
     {
     }
 
-};
\ No newline at end of file
+};
+
+// Largest board side of the supported variants (see Variant.h)
+const int Max_board_size = 10;
+
+// Longest capture series: every hop captures one of the opponent checkers, at most 20 on 10x10
+const int Max_hops = 20;
+
+// A full turn: one quiet move or a whole capture series, hop by hop.
+// The captured checkers are the xb, yb of the hops. Hops are stored in place, so turns are cheap to copy.
+struct move_seq
+{
+    move_pos hops[Max_hops];
+    POS_T size = 0;
+
+    move_seq() = default;
+
+    move_seq(const move_pos& hop)
+    {
+        push_back(hop);
+    }
+
+    void push_back(const move_pos& hop)
+    {
+        hops[size++] = hop;
+    }
+
+    void pop_back()
+    {
+        --size;
+    }
+
+    const move_pos& front() const
+    {
+        return hops[0];
+    }
+
+    const move_pos& back() const
+    {
+        return hops[size - 1];
+    }
+
+    const move_pos* begin() const
+    {
+        return hops;
+    }
+
+    const move_pos* end() const
+    {
+        return hops + size;
+    }
+
+    std::vector<move_pos> to_vector() const
+    {
+        return std::vector<move_pos>(begin(), end());
+    }
+
+    bool is_capture() const
+    {
+        return hops[0].xb != -1;
+    }
+
+    // bit (x * Max_board_size + y) / 2 is set for every captured checker: dark cells get distinct bits
+    uint64_t captured() const
+    {
+        uint64_t res = 0;
+        for (const auto& hop : *this)
+        {
+            if (hop.xb != -1)
+                res |= uint64_t(1) << ((hop.xb * Max_board_size + hop.yb) / 2);
+        }
+        return res;
+    }
+};
+
+// Vector-like list of at most N elements stored in place, so the search can keep its
+// turn lists without allocating. Adding an element past the capacity throws runtime_error.
+template <class T, size_t N>
+struct fixed_list
+{
+    T items[N];
+    size_t size = 0;
+
+    void push_back(const T& item)
+    {
+        if (size == N)
+            throw std::runtime_error("fixed_list: more than its capacity of elements");
+        items[size++] = item;
+    }
+
+    void clear()
+    {
+        size = 0;
+    }
+
+    bool empty() const
+    {
+        return size == 0;
+    }
+
+    T& operator[](const size_t i)
+    {
+        return items[i];
+    }
+
+    const T& operator[](const size_t i) const
+    {
+        return items[i];
+    }
+
+    T* begin()
+    {
+        return items;
+    }
+
+    T* end()
+    {
+        return items + size;
+    }
+
+    const T* begin() const
+    {
+        return items;
+    }
+
+    const T* end() const
+    {
+        return items + size;
+    }
+};
+
+// Most full turns in one position. The generator keeps only distinct turns in the list (capture series
+// leading to the same position once, under the majority rule only the longest ones), never raw paths;
+// a position with more turns makes the list throw.
+const size_t Max_turns = 256;
+
+typedef fixed_list<move_pos, Max_turns> hop_list;
+typedef fixed_list<move_seq, Max_turns> move_list;
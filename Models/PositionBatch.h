@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Positions for the batch evaluation (see Game/BatchEval.h) as a structure of arrays: one bit mask per
+// kind of piece and position. Bit k is the dark cell k in row-major order (square k + 1 of the FEN),
+// 50 cells at most, so 10x10 boards fit as well.
+struct position_batch
+{
+    std::vector<uint64_t> white_men, black_men, white_queens, black_queens;
+    // the side each position is scored for, as first_bot_color of calc_score
+    std::vector<uint8_t> color;
+
+    size_t size() const
+    {
+        return color.size();
+    }
+
+    void reserve(const size_t n)
+    {
+        white_men.reserve(n);
+        black_men.reserve(n);
+        white_queens.reserve(n);
+        black_queens.reserve(n);
+        color.reserve(n);
+    }
+
+    void clear()
+    {
+        white_men.clear();
+        black_men.clear();
+        white_queens.clear();
+        black_queens.clear();
+        color.clear();
+    }
+};
@@ -8,5 +8,6 @@ enum class Reponse
     BACK,   // Undo or return to the previous state/step
     REPLAY, // Repeat a game round or restart the current part
     QUIT,   // Exit the game or end the session
-    CELL    // Action related to selecting or processing a cell on the game board
+    CELL,   // Action related to selecting or processing a cell on the game board
+    TIMEOUT // The time of the player on the clock ran out
 };
\ No newline at end of file
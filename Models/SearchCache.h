@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+
+// One slot of the search cache (Game/SearchCache.h)
+struct cache_entry
+{
+    // key of the position (SearchCache::key) xor a mix of the other fields: an entry torn by a crash
+    // or changed on disk does not match its position any more and is never used
+    uint64_t check = 0;
+    // negamax score for the side to move, see Bound
+    double score = 0;
+    // plies searched below the position
+    uint8_t depth = 0;
+    // SearchCache::Bound, Empty - a free slot
+    uint8_t bound = 0;
+    // best turn: the cells (x * size + y) of its first hop and where its last hop ends, No_cell if none
+    uint8_t from = 0;
+    uint8_t to = 0;
+    // generation of the search that wrote it, entries of older ones are replaced first
+    uint8_t age = 0;
+    uint8_t reserved[3] = {};
+};
+
+// Start of a search cache file, followed by the table itself: buckets * SearchCache::Bucket_size entries
+struct cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t board_size;
+    uint64_t buckets;
+    // generation of the last search, the next session goes on from it
+    uint32_t age;
+    uint32_t reserved;
+    // of the table, checked by Tools/cache; the search checks every entry it reads by itself instead
+    uint64_t checksum;
+    // of the fields above
+    uint64_t header_checksum;
+};
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Self-play games of the distributed job (see Game/SelfPlay.h). A game is made from the job and its
+// index alone, so any worker plays it the same way and a lost game is simply played again.
+struct selfplay_job
+{
+    uint32_t games = 0;
+    // level of both bots
+    uint8_t level = 4;
+    // random legal turns before the bots take over, the opening of every game is its own
+    uint8_t opening_turns = 6;
+    uint16_t max_turns = 120;
+    uint64_t seed = 1;
+
+    bool operator==(const selfplay_job& other) const
+    {
+        return games == other.games && level == other.level && opening_turns == other.opening_turns &&
+            max_turns == other.max_turns && seed == other.seed;
+    }
+};
+
+// A played game. Every turn is the cells x * size + y it goes through: the start and every landing.
+struct selfplay_game
+{
+    uint32_t index = 0;
+    // 0 - draw, 1 - white won, 2 - black won
+    uint8_t result = 0;
+    // search nodes and milliseconds of both bots together
+    uint64_t nodes = 0;
+    uint32_t ms = 0;
+    std::vector<std::vector<uint8_t>> turns;
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include "Move.h"
+
+// Rules of a draughts variant, known at compile time. The board, the move generator, the evaluation
+// and the position format are templates on it, so every variant gets its own code without runtime checks.
+// White men start at the bottom (the last rows) and go up to row 0, black men go down to row Size - 1.
+struct Russian
+{
+    static constexpr POS_T Size = 8;
+    // rows of men of each side at the start
+    static constexpr POS_T Men_rows = 3;
+    static constexpr bool Men_capture_backward = true;
+    // queens move and capture along the whole diagonal
+    static constexpr bool Flying_kings = true;
+    // only the capture series with the most captured checkers may be chosen
+    static constexpr bool Majority_capture = false;
+    // a man reaching the last row in a capture series becomes a queen at once and goes on capturing
+    // as a queen; otherwise it becomes a queen only if the series ends there
+    static constexpr bool Promote_during_capture = true;
+    // the checkers captured in a series stay on the board until it ends (the Turkish strike rule): they
+    // block the way and can't be jumped twice; otherwise each one is removed as soon as it is jumped
+    static constexpr bool Remove_captured_after_series = false;
+};
+
+// International draughts on the 10x10 board
+struct International
+{
+    static constexpr POS_T Size = 10;
+    static constexpr POS_T Men_rows = 4;
+    static constexpr bool Men_capture_backward = true;
+    static constexpr bool Flying_kings = true;
+    static constexpr bool Majority_capture = true;
+    static constexpr bool Promote_during_capture = false;
+    static constexpr bool Remove_captured_after_series = true;
+};
+
+// Diagonal directions: up-left, up-right, down-left, down-right
+constexpr POS_T Dir_x[4] = { -1, -1, 1, 1 };
+constexpr POS_T Dir_y[4] = { -1, 1, -1, 1 };
+
+// Rays of the board of variant V: from every cell in every direction, the cells up to the edge,
+// the nearest (the neighbour) first. Built at compile time, so the move generator walks a table
+// instead of checking the board bounds.
+template <class V>
+struct Geometry
+{
+    struct Cell
+    {
+        POS_T x = 0, y = 0;
+    };
+
+    Cell ray[V::Size][V::Size][4][V::Size - 1]{};
+    POS_T ray_len[V::Size][V::Size][4]{};
+
+    static constexpr Geometry make()
+    {
+        Geometry g{};
+        for (POS_T x = 0; x < V::Size; ++x)
+        {
+            for (POS_T y = 0; y < V::Size; ++y)
+            {
+                for (int d = 0; d < 4; ++d)
+                {
+                    POS_T len = 0;
+                    for (int i = x + Dir_x[d], j = y + Dir_y[d]; i >= 0 && i < V::Size && j >= 0 && j < V::Size;
+                         i += Dir_x[d], j += Dir_y[d])
+                    {
+                        g.ray[x][y][d][len].x = POS_T(i);
+                        g.ray[x][y][d][len].y = POS_T(j);
+                        ++len;
+                    }
+                    g.ray_len[x][y][d] = len;
+                }
+            }
+        }
+        return g;
+    }
+};
+
+template <class V>
+inline constexpr Geometry<V> geometry = Geometry<V>::make();
@@ -0,0 +1,110 @@
+// Batch position analysis: reads positions (one per line, see Game/Fen.h, "#" starts a comment)
+// from a file or stdin, analyses them in parallel and writes one JSON object per position to stdout.
+//
+// analyze [--lines K] [--depth D] [--time-ms T] [--threads N] [file]
+
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+
+#include "../Game/Fen.h"
+#include "../Game/Logic.h"
+#include "../Game/ThreadPool.h"
+
+using json = nlohmann::json;
+
+int main(int argc, char* argv[])
+{
+    size_t lines = 3;
+    int depth = 8;
+    int time_ms = 0;
+    size_t threads = max(1u, thread::hardware_concurrency());
+    string file;
+    for (int i = 1; i < argc; ++i)
+    {
+        const string arg = argv[i];
+        if (i + 1 < argc && arg == "--lines")
+            lines = stoul(argv[++i]);
+        else if (i + 1 < argc && arg == "--depth")
+            depth = stoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--time-ms")
+            time_ms = stoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--threads")
+            threads = max<size_t>(1, stoul(argv[++i]));
+        else if (arg[0] != '-')
+            file = arg;
+        else
+        {
+            cerr << "usage: analyze [--lines K] [--depth D] [--time-ms T] [--threads N] [file]\n";
+            return 1;
+        }
+    }
+
+    ifstream fin;
+    if (!file.empty())
+    {
+        fin.open(file);
+        if (!fin)
+        {
+            cerr << "can't open " << file << "\n";
+            return 1;
+        }
+    }
+    istream& in = file.empty() ? cin : fin;
+
+    // every worker has its own board (for the position history) and Logic
+    Config config;
+    vector<unique_ptr<Board>> boards;
+    vector<unique_ptr<Logic>> logics;
+    for (size_t i = 0; i < threads; ++i)
+    {
+        boards.push_back(make_unique<Board>());
+        logics.push_back(make_unique<Logic>(boards.back().get(), &config));
+    }
+
+    search_limits limits;
+    limits.depth = depth;
+    limits.time_ms = time_ms;
+
+    mutex out_mtx;
+    ThreadPool pool(threads, 4 * threads);
+    string text;
+    for (size_t id = 1; getline(in, text); ++id)
+    {
+        const auto first = text.find_first_not_of(" \t\r");
+        if (first == string::npos || text[first] == '#')
+            continue;
+        pool.push([&, id, text](const size_t worker) {
+            json res;
+            res["id"] = id;
+            res["fen"] = text.substr(text.find_first_not_of(" \t"));
+            try
+            {
+                vector<vector<POS_T>> mtx;
+                bool color;
+                Fen::parse(text, mtx, color);
+                const auto start = chrono::steady_clock::now();
+                auto analysis = logics[worker]->analyze(mtx, color, lines, limits);
+                res["depth"] = analysis.depth;
+                res["nodes"] = analysis.nodes;
+                res["time_ms"] = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                res["lines"] = json::array();
+                for (const auto& line : analysis.lines)
+                {
+                    res["lines"].push_back({ { "turn", Fen::turn_to_string(line.turn) },
+                                             { "score", line.score },
+                                             { "pv", Fen::line_to_strings(line.pv) } });
+                }
+            }
+            catch (const exception& e)
+            {
+                res["error"] = e.what();
+            }
+            lock_guard<mutex> lock(out_mtx);
+            cout << res.dump() << endl;
+        });
+    }
+    pool.wait();
+    return 0;
+}
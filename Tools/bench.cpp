@@ -0,0 +1,455 @@
+// Microbenchmarks of the engine: move generation, turns, evaluation (one by one and batched), position
+// history, search at fixed levels on a fixed position suite and a headless bot game. Every benchmark is
+// warmed up, then timed in several repetitions; the statistics go to stdout (or --out) as JSON, a table
+// goes to stderr.
+// With --compare the run is compared against a stored result and regressions beyond the threshold
+// are reported (exit code 2). With --compare and a result file nothing is run, the two files are compared.
+//
+// bench [--repeat N] [--warmup W] [--min-time-ms T] [--cpu C] [--filter TEXT] [--out FILE]
+//       [--compare BASELINE [--threshold PCT]] [result]
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "../Game/BatchEval.h"
+#include "../Game/Fen.h"
+#include "../Game/Logic.h"
+
+using json = nlohmann::json;
+
+// Positions of the suite: the start and positions after random openings, with quiet and capture turns,
+// men and queens. Changing them makes the results incomparable with older ones.
+const vector<string> Suite = {
+    "start",
+    "W:WK2,21,29:B4,11,12,14,K23",
+    "W:W21,25,28,31:B2,12,K14,16,19",
+    "W:W7,17,20,24,25,26,29,30,31:B1,3,4,6,8,9,10,18,21",
+    "B:W26,29:B6,8,9,12,15",
+    "W:W30:B1,4,10,11,K20,21",
+    "W:W23,24,25,26,28,29,30,31,32:B1,2,3,4,5,6,7,10,12,14,15",
+    "B:W20,21,22,23,26,27,28,29,30,31,32:B1,2,3,4,5,6,7,9,12,14,15",
+    "B:W10,20,24,26,30:B3,4,9,11,13",
+    "B:WK10,25,26,29,30,32:B1,3,5,8,17",
+    "W:W22,23,24,29,31:B1,2,3,4,7,12,13",
+    "W:W21,28,30,32:B2,3,4,5,12,23,25",
+    "B:W18,19,20,24:B2,3,4,6,8,10,11,13,17",
+    "W:W12,21,26,27,28,29,30,31,32:B1,2,3,4,5,7,8,13,20",
+    "W:W20,21,22,23,24,29,31:B2,3,4,8,9,11,14,16",
+    "W:W19,21,22,23,24,25,28,29,30,31,32:B1,3,4,5,6,7,10,12,13,14,15,16",
+    "B:W12,K16,26,29,31:B14",
+    "W:W21,25,26,27,28,29,32:B1,2,3,4,9,10,11,16",
+    "W:W21,32:B2,4,5,6,13,18",
+    "W:W12,18,20,21,22,25,26,32:B5,6,11,13",
+    "B:W8,19:B9,K31",
+    "B:W12,14,17,19,21,24,26,29,31,32:B1,2,3,6,7,10,11",
+    "B:W25:B1,K2,4,5,8,10,19",
+    "B:WK3,21,22,23,29,30,32:B1,6,28",
+    "B:W14,18,20,22,25,27,29,31,32:B2,6,7,8,11,19",
+};
+
+// seed of the choice between equal turns, so that every run searches the same trees
+const unsigned Bench_seed = 1;
+
+struct position
+{
+    vector<vector<POS_T>> mtx;
+    bool color;
+    vector<move_seq> turns;
+};
+
+// One pass over the workload of a benchmark
+struct pass_result
+{
+    // operations done, the time is reported per operation
+    size_t ops = 0;
+    // work done inside the operations (search nodes), 0 if not counted
+    size_t items = 0;
+    // depends on the results of the operations: keeps the compiler from dropping them and shows
+    // when a change of the engine changed the work itself (a search visiting other nodes)
+    uint64_t checksum = 0;
+};
+
+struct benchmark
+{
+    string name;
+    function<pass_result()> pass;
+};
+
+struct bench_stats
+{
+    string name;
+    size_t iterations = 0;
+    pass_result work;
+    // nanoseconds per operation of every repetition
+    vector<double> samples;
+    double median = 0, mean = 0, min = 0, max = 0, stddev = 0;
+};
+
+static double median_of(vector<double> v)
+{
+    sort(v.begin(), v.end());
+    const size_t n = v.size();
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static bool pin_to_cpu(const int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Plays a game bot against bot at level 4 from the start until it ends by the game rules,
+// the history of the board gets every position for the draw rules
+static pass_result play_game(Board& board, Logic& logic, Config& config)
+{
+    pass_result res;
+    vector<vector<POS_T>> mtx;
+    bool color;
+    Fen::parse("start", mtx, color);
+    board.history.clear();
+    board.history.push(Zobrist::hash(mtx, color), false);
+    logic.seed(Bench_seed);
+    logic.Max_depth = 4;
+    const int max_turns = config("Game", "MaxNumTurns");
+    for (int turn_num = 0; turn_num < max_turns && !logic.is_game_drawn(); ++turn_num)
+    {
+        const auto hops = logic.find_best_turns(mtx, color);
+        if (hops.empty())
+            break;
+        res.items += logic.nodes;
+        move_seq seq;
+        for (const auto& hop : hops)
+            seq.push_back(hop);
+        const bool reversible = Logic::is_reversible(mtx, seq);
+        mtx = logic.make_turn(mtx, seq);
+        color = !color;
+        board.history.push(Zobrist::hash(mtx, color), reversible);
+        ++res.ops;
+    }
+    res.checksum = board.history.top();
+    return res;
+}
+
+static vector<benchmark> make_benchmarks(vector<position>& suite, Board& board, Logic& logic, Config& config)
+{
+    vector<benchmark> res;
+    res.push_back({ "find_sequences", [&] {
+        pass_result r;
+        for (const auto& p : suite)
+        {
+            r.checksum += logic.find_sequences(p.mtx, p.color).size();
+            ++r.ops;
+        }
+        return r;
+    } });
+    res.push_back({ "make_turn", [&] {
+        pass_result r;
+        for (const auto& p : suite)
+        {
+            for (const auto& seq : p.turns)
+            {
+                const auto mtx = logic.make_turn(p.mtx, seq);
+                r.checksum += mtx[seq.back().x2][seq.back().y2];
+                ++r.ops;
+            }
+        }
+        return r;
+    } });
+    res.push_back({ "calc_score", [&] {
+        pass_result r;
+        for (const auto& p : suite)
+        {
+            r.checksum += uint64_t(logic.calc_score(p.mtx, p.color) * 1000);
+            ++r.ops;
+        }
+        return r;
+    } });
+    // the suite repeated to a batch of 4096 positions, scored at once by the scalar and the AVX2 code
+    // (the same code where the processor has no AVX2)
+    const bool potential = (config("Bot", "BotScoringType") == "NumberAndPotential");
+    position_batch batch;
+    for (size_t i = 0; i < 4096; ++i)
+        BatchEval::add(batch, suite[i % suite.size()].mtx, suite[i % suite.size()].color);
+    for (const bool simd : { false, true })
+    {
+        res.push_back({ simd ? "eval_batch_avx2" : "eval_batch_scalar", [&, batch, potential, simd] {
+            pass_result r;
+            vector<double> scores(batch.size());
+            BatchEval::evaluate(batch, scores.data(), potential, 0, batch.size(), simd);
+            for (const double score : scores)
+                r.checksum += uint64_t(score * 1000);
+            r.items = batch.size();
+            ++r.ops;
+            return r;
+        } });
+    }
+    // the search pushes and pops a position per node and checks it for repetitions: the same on a deep line
+    res.push_back({ "history_push_pop", [&] {
+        pass_result r;
+        PositionHistory history;
+        history.reserve(Max_ply * suite.size());
+        for (const auto& p : suite)
+        {
+            const uint64_t hash = Zobrist::hash(p.mtx, p.color);
+            for (size_t i = 0; i < Max_ply; ++i)
+            {
+                history.push(hash ^ (i & 3), true);
+                r.checksum += history.repetitions();
+                ++r.ops;
+            }
+        }
+        while (history.size())
+            history.pop();
+        return r;
+    } });
+    res.push_back({ "zobrist_hash", [&] {
+        pass_result r;
+        for (const auto& p : suite)
+        {
+            r.checksum ^= Zobrist::hash(p.mtx, p.color);
+            ++r.ops;
+        }
+        return r;
+    } });
+    for (const int level : { 4, 6, 8 })
+    {
+        res.push_back({ "search_level_" + to_string(level), [&, level] {
+            pass_result r;
+            logic.seed(Bench_seed);
+            logic.Max_depth = level;
+            for (const auto& p : suite)
+            {
+                board.history.clear();
+                board.history.push(Zobrist::hash(p.mtx, p.color), false);
+                const auto hops = logic.find_best_turns(p.mtx, p.color);
+                r.checksum = r.checksum * 31 + logic.nodes + hops.size();
+                r.items += logic.nodes;
+                ++r.ops;
+            }
+            return r;
+        } });
+    }
+    res.push_back({ "game_level_4", [&] { return play_game(board, logic, config); } });
+    return res;
+}
+
+static bench_stats run_benchmark(const benchmark& b, const int repeat, const int warmup, const double min_time_ms)
+{
+    bench_stats res;
+    res.name = b.name;
+
+    // the warmup passes also find how many passes a repetition needs to last min_time_ms
+    double pass_ms = 0;
+    for (int i = 0; i < max(warmup, 1); ++i)
+    {
+        const auto start = chrono::steady_clock::now();
+        res.work = b.pass();
+        pass_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+    res.iterations = max<size_t>(1, size_t(ceil(min_time_ms / max(pass_ms, 1e-3))));
+
+    for (int rep = 0; rep < repeat; ++rep)
+    {
+        size_t ops = 0;
+        const auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < res.iterations; ++i)
+        {
+            const auto work = b.pass();
+            ops += work.ops;
+            if (work.checksum != res.work.checksum)
+                throw runtime_error(b.name + " gives different results in different passes");
+        }
+        const double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+        res.samples.push_back(ns / max<size_t>(ops, 1));
+    }
+
+    res.median = median_of(res.samples);
+    res.min = *min_element(res.samples.begin(), res.samples.end());
+    res.max = *max_element(res.samples.begin(), res.samples.end());
+    for (const double s : res.samples)
+        res.mean += s / res.samples.size();
+    for (const double s : res.samples)
+        res.stddev += (s - res.mean) * (s - res.mean) / max<size_t>(res.samples.size() - 1, 1);
+    res.stddev = sqrt(res.stddev);
+    return res;
+}
+
+static json to_json(const bench_stats& s)
+{
+    json res = { { "name", s.name },
+                 { "ops", s.work.ops },
+                 { "iterations", s.iterations },
+                 { "repetitions", s.samples.size() },
+                 { "median_ns", s.median },
+                 { "mean_ns", s.mean },
+                 { "min_ns", s.min },
+                 { "max_ns", s.max },
+                 { "stddev_ns", s.stddev },
+                 { "cv", s.mean > 0 ? s.stddev / s.mean : 0 },
+                 { "checksum", s.work.checksum } };
+    if (s.work.items)
+    {
+        res["items"] = s.work.items;
+        // items per second at the median time
+        res["items_per_second"] = s.work.items / (s.median * s.work.ops) * 1e9;
+    }
+    return res;
+}
+
+// Compares the median times per operation of the benchmarks present in both results.
+// Returns the number of regressions: benchmarks slower than the baseline by more than threshold percent.
+static int compare(const json& baseline, const json& result, const double threshold)
+{
+    int regressions = 0;
+    cerr << left << setw(20) << "benchmark" << right << setw(14) << "baseline ns" << setw(14) << "result ns"
+         << setw(10) << "change" << "\n";
+    for (const auto& cur : result["benchmarks"])
+    {
+        const auto base = find_if(baseline["benchmarks"].begin(), baseline["benchmarks"].end(),
+            [&](const json& b) { return b["name"] == cur["name"]; });
+        if (base == baseline["benchmarks"].end())
+            continue;
+        const double old_ns = (*base)["median_ns"], new_ns = cur["median_ns"];
+        const double change = (new_ns / old_ns - 1) * 100;
+        string note;
+        if (change > threshold)
+        {
+            note = "  REGRESSION";
+            ++regressions;
+        }
+        else if (change < -threshold)
+            note = "  faster";
+        if ((*base)["checksum"] != cur["checksum"])
+            note += "  (other results: the work itself changed)";
+        cerr << left << setw(20) << cur["name"].get<string>() << right << fixed << setprecision(1) << setw(14)
+             << old_ns << setw(14) << new_ns << setw(9) << showpos << change << noshowpos << "%" << note << "\n";
+    }
+    cerr << regressions << " regression(s) beyond " << threshold << "%\n";
+    return regressions;
+}
+
+static json read_json(const string& file)
+{
+    ifstream fin(file);
+    if (!fin)
+        throw runtime_error("can't open " + file);
+    json res;
+    fin >> res;
+    return res;
+}
+
+int main(int argc, char* argv[])
+{
+    int repeat = 7;
+    int warmup = 1;
+    double min_time_ms = 100;
+    int cpu = -1;
+    string filter, out_file, baseline_file, result_file;
+    double threshold = 5;
+    for (int i = 1; i < argc; ++i)
+    {
+        const string arg = argv[i];
+        if (i + 1 < argc && arg == "--repeat")
+            repeat = max(1, stoi(argv[++i]));
+        else if (i + 1 < argc && arg == "--warmup")
+            warmup = max(0, stoi(argv[++i]));
+        else if (i + 1 < argc && arg == "--min-time-ms")
+            min_time_ms = stod(argv[++i]);
+        else if (i + 1 < argc && arg == "--cpu")
+            cpu = stoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--filter")
+            filter = argv[++i];
+        else if (i + 1 < argc && arg == "--out")
+            out_file = argv[++i];
+        else if (i + 1 < argc && arg == "--compare")
+            baseline_file = argv[++i];
+        else if (i + 1 < argc && arg == "--threshold")
+            threshold = stod(argv[++i]);
+        else if (arg[0] != '-')
+            result_file = arg;
+        else
+        {
+            cerr << "usage: bench [--repeat N] [--warmup W] [--min-time-ms T] [--cpu C] [--filter TEXT] [--out FILE]\n"
+                    "             [--compare BASELINE [--threshold PCT]] [result]\n";
+            return 1;
+        }
+    }
+
+    try
+    {
+        json result;
+        if (!result_file.empty())
+        {
+            if (baseline_file.empty())
+                throw runtime_error("a result file is only read with --compare");
+            result = read_json(result_file);
+        }
+        else
+        {
+            if (cpu >= 0 && !pin_to_cpu(cpu))
+                cerr << "can't pin to cpu " << cpu << ", running unpinned\n";
+
+            Config config;
+            Board board;
+            Logic logic(&board, &config);
+            vector<position> suite;
+            for (const auto& fen : Suite)
+            {
+                position p;
+                Fen::parse(fen, p.mtx, p.color);
+                p.turns = logic.find_sequences(p.mtx, p.color);
+                suite.push_back(p);
+            }
+
+            result["context"] = { { "positions", suite.size() },
+                                  { "optimization", config("Bot", "Optimization") },
+                                  { "repeat", repeat },
+                                  { "warmup", warmup },
+                                  { "min_time_ms", min_time_ms },
+                                  { "cpu", cpu },
+                                  { "compiler", __VERSION__ } };
+            result["benchmarks"] = json::array();
+            cerr << left << setw(20) << "benchmark" << right << setw(14) << "median ns" << setw(10) << "cv"
+                 << setw(16) << "items/s" << "\n";
+            for (const auto& b : make_benchmarks(suite, board, logic, config))
+            {
+                if (b.name.find(filter) == string::npos)
+                    continue;
+                const auto stats = run_benchmark(b, repeat, warmup, min_time_ms);
+                const auto j = to_json(stats);
+                result["benchmarks"].push_back(j);
+                cerr << left << setw(20) << stats.name << right << fixed << setprecision(1) << setw(14) << stats.median
+                     << setprecision(3) << setw(10) << j["cv"].get<double>() << setprecision(0) << setw(16)
+                     << (j.contains("items_per_second") ? j["items_per_second"].get<double>() : 0.0) << "\n";
+            }
+
+            if (out_file.empty())
+                cout << result.dump(2) << endl;
+            else
+                ofstream(out_file) << result.dump(2) << endl;
+        }
+
+        if (!baseline_file.empty() && compare(read_json(baseline_file), result, threshold))
+            return 2;
+    }
+    catch (const exception& e)
+    {
+        cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,151 @@
+// Search cache files (see Game/SearchCache.h): the search_cache.bin of the game and the caches of self-play workers.
+//
+// cache info FILE...
+//     One JSON line per file: the table size, its intact entries by bound and by plies searched, the torn ones
+//     and whether the checksum of the table holds.
+// cache merge [--size-mb M] OUT FILE...
+//     Combines the caches into OUT: the intact entries of all files, the deepest one of a position, in a table
+//     of M MB (as large as the largest file by default). OUT may be one of the files.
+// cache compact [--size-mb M] [--min-depth D] FILE [OUT]
+//     Rewrites FILE (or writes OUT) without torn entries and the ones searched less than D plies deep, in a
+//     table of M MB (the size of FILE by default).
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <nlohmann/json.hpp>
+
+#include "../Game/Board.h"
+#include "../Game/SearchCache.h"
+
+using json = nlohmann::json;
+
+static unique_ptr<SearchCache> open_cache(const string& path)
+{
+    auto res = make_unique<SearchCache>(Russian::Size, 0);
+    if (!res->load(path, true))
+        throw runtime_error(path + " is not a search cache of this board");
+    if (res->checksum() != res->file_header().checksum)
+        cerr << path << ": checksum mismatch, only the intact entries are used\n";
+    return res;
+}
+
+static double size_mb(const SearchCache& cache)
+{
+    return double(cache.capacity() * sizeof(cache_entry)) / (1 << 20);
+}
+
+static json info(const string& path)
+{
+    const auto cache = open_cache(path);
+    size_t used = 0;
+    map<int, size_t> depths;
+    size_t bounds[4] = {};
+    cache->for_each([&](uint64_t, const cache_entry& entry) {
+        ++used;
+        ++depths[entry.depth];
+        ++bounds[entry.bound];
+    });
+    json res = { { "file", path }, { "size_mb", size_mb(*cache) }, { "entries", cache->capacity() }, { "used", used },
+        { "torn", cache->occupied() - used }, { "exact", bounds[SearchCache::Exact] },
+        { "lower", bounds[SearchCache::Lower] }, { "upper", bounds[SearchCache::Upper] },
+        { "checksum_ok", cache->checksum() == cache->file_header().checksum } };
+    for (const auto& [depth, count] : depths)
+        res["depths"][to_string(depth)] = count;
+    return res;
+}
+
+static void usage()
+{
+    cerr << "usage: cache info FILE...\n"
+            "       cache merge [--size-mb M] OUT FILE...\n"
+            "       cache compact [--size-mb M] [--min-depth D] FILE [OUT]\n";
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        usage();
+        return 1;
+    }
+    const string mode = argv[1];
+    size_t mb = 0;
+    int min_depth = 0;
+    vector<string> files;
+    for (int i = 2; i < argc; ++i)
+    {
+        const string arg = argv[i];
+        if (i + 1 < argc && arg == "--size-mb")
+            mb = stoul(argv[++i]);
+        else if (i + 1 < argc && arg == "--min-depth")
+            min_depth = stoi(argv[++i]);
+        else if (arg[0] != '-')
+            files.push_back(arg);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    try
+    {
+        if (mode == "info")
+        {
+            for (const auto& file : files)
+                cout << info(file).dump() << endl;
+            return 0;
+        }
+        if (mode != "merge" && mode != "compact")
+        {
+            usage();
+            return 1;
+        }
+        if (files.size() < (mode == "merge" ? 2u : 1u))
+        {
+            usage();
+            return 1;
+        }
+        const string out_path = (mode == "merge" || files.size() == 1) ? files[0] : files[1];
+        vector<string> inputs(files.begin() + (mode == "merge"), files.end());
+        if (mode == "compact")
+            inputs.resize(1);
+
+        vector<unique_ptr<SearchCache>> caches;
+        for (const auto& path : inputs)
+            caches.push_back(open_cache(path));
+        // the output starts as the largest input emptied, unless another size is asked for
+        unique_ptr<SearchCache> out;
+        if (mb)
+            out = make_unique<SearchCache>(Russian::Size, mb);
+        else
+        {
+            const auto largest = max_element(caches.begin(), caches.end(),
+                [](const auto& a, const auto& b) { return a->capacity() < b->capacity(); });
+            out = make_unique<SearchCache>(Russian::Size, 0);
+            out->load(inputs[largest - caches.begin()], true);
+            out->clear();
+        }
+        size_t read = 0, kept = 0;
+        for (const auto& cache : caches)
+        {
+            cache->for_each([&](const uint64_t key, const cache_entry& entry) {
+                ++read;
+                if (entry.depth >= min_depth)
+                    out->merge(key, entry);
+            });
+        }
+        out->for_each([&](uint64_t, const cache_entry&) { ++kept; });
+        caches.clear();
+        if (!out->save(out_path))
+            throw runtime_error("can't write " + out_path);
+        cout << json{ { "file", out_path }, { "size_mb", size_mb(*out) }, { "read", read }, { "kept", kept } }.dump() << endl;
+    }
+    catch (const exception& e)
+    {
+        cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,10 @@
+// Engine protocol server: reads commands from stdin and answers to stdout, see Game/Engine.h.
+
+#include "../Game/Engine.h"
+
+int main()
+{
+    Config config;
+    Engine engine(&config);
+    return engine.run(cin, cout);
+}
@@ -0,0 +1,281 @@
+// Position database of game collections, see Game/PositionDb.h.
+//
+// posdb build [--memory-mb M] DB [games]
+//     Indexes the games of the file (or stdin) into DB. Games are written in the style of PDN move text:
+//     turns as in Fen::turn_to_string ("22-18", "26x17x10" or "26x10"), move numbers ("1.") and {comments}
+//     are skipped, a [FEN "..."] tag gives the start position of the next game, and every game ends
+//     with its result: 1-0 / 2-0 (white wins), 0-1 / 0-2 (black wins), 1/2-1/2 / 1-1 (draw) or * (unknown).
+//     Games with illegal turns are skipped and reported on stderr.
+// posdb query [--games K] DB [positions]
+//     For every position of the file (or stdin, one per line, "#" starts a comment) writes a JSON line
+//     with the number of games that reached it, their results and the first K of them (id, ply and
+//     the byte offset of the game in the indexed file).
+
+#include <chrono>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+#include "../Game/PositionDb.h"
+
+using json = nlohmann::json;
+
+struct game_record
+{
+    string fen = "start";
+    vector<string> turns;
+    game_result result = game_result::unknown;
+    // byte offset of the game in the input
+    uint64_t offset = 0;
+    bool started = false;
+};
+
+// Splits PDN style move text into games, keeping the offset of each game in the input
+class GameReader
+{
+public:
+    explicit GameReader(istream& in) : in(in)
+    {
+    }
+
+    bool next(game_record& game)
+    {
+        game = game_record();
+        while (true)
+        {
+            if (pos >= line.size())
+            {
+                line_start = next_line_start;
+                if (!getline(in, line))
+                {
+                    line.clear();
+                    return game.started;
+                }
+                next_line_start += line.size() + 1;
+                pos = 0;
+                if (!in_comment && !line.empty() && line[0] == '[')
+                {
+                    read_tag(game);
+                    pos = line.size();
+                }
+                continue;
+            }
+            if (in_comment)
+            {
+                const auto end = line.find('}', pos);
+                in_comment = (end == string::npos);
+                pos = in_comment ? line.size() : end + 1;
+                continue;
+            }
+            if (isspace(static_cast<unsigned char>(line[pos])))
+            {
+                ++pos;
+                continue;
+            }
+            if (line[pos] == '{')
+            {
+                in_comment = true;
+                ++pos;
+                continue;
+            }
+
+            const size_t start = pos;
+            while (pos < line.size() && !isspace(static_cast<unsigned char>(line[pos])) && line[pos] != '{')
+                ++pos;
+            string token = line.substr(start, pos - start);
+            start_game(game, start);
+            if (read_result(token, game.result))
+                return true;
+            // move number: "1." or "1..." before the turn or as a token of its own
+            size_t digits = 0;
+            while (digits < token.size() && isdigit(static_cast<unsigned char>(token[digits])))
+                ++digits;
+            if (digits && digits < token.size() && token[digits] == '.')
+            {
+                const auto turn_at = token.find_first_not_of('.', digits);
+                token = (turn_at == string::npos) ? "" : token.substr(turn_at);
+            }
+            if (!token.empty())
+                game.turns.push_back(token);
+        }
+    }
+
+private:
+    void start_game(game_record& game, const size_t at)
+    {
+        if (!game.started)
+        {
+            game.started = true;
+            game.offset = line_start + at;
+        }
+    }
+
+    void read_tag(game_record& game)
+    {
+        start_game(game, 0);
+        if (line.compare(0, 5, "[FEN ") != 0)
+            return;
+        const auto open = line.find('"'), close = line.rfind('"');
+        if (open != string::npos && close > open)
+            game.fen = line.substr(open + 1, close - open - 1);
+    }
+
+    static bool read_result(const string& token, game_result& result)
+    {
+        if (token == "1-0" || token == "2-0")
+            result = game_result::white_wins;
+        else if (token == "0-1" || token == "0-2")
+            result = game_result::black_wins;
+        else if (token == "1/2-1/2" || token == "1-1")
+            result = game_result::draw;
+        else if (token == "*")
+            result = game_result::unknown;
+        else
+            return false;
+        return true;
+    }
+
+    istream& in;
+    string line;
+    size_t pos = 0;
+    // offsets of the current and the next line
+    uint64_t line_start = 0;
+    uint64_t next_line_start = 0;
+    bool in_comment = false;
+};
+
+static int build(const string& db_path, const string& file, const size_t memory_mb)
+{
+    ifstream fin;
+    if (!file.empty())
+    {
+        fin.open(file, ios::binary);
+        if (!fin)
+        {
+            cerr << "can't open " << file << "\n";
+            return 1;
+        }
+    }
+    istream& in = file.empty() ? cin : fin;
+
+    Config config;
+    PositionDbBuilder builder(db_path, &config, memory_mb);
+    GameReader reader(in);
+    game_record game;
+    size_t skipped = 0;
+    const auto start = chrono::steady_clock::now();
+    while (reader.next(game))
+    {
+        try
+        {
+            builder.add_game(game.fen, game.turns, game.result, game.offset);
+        }
+        catch (const exception& e)
+        {
+            cerr << "game at offset " << game.offset << " skipped: " << e.what() << "\n";
+            ++skipped;
+        }
+    }
+    builder.finish();
+    cerr << builder.games() << " games indexed, " << skipped << " skipped in "
+         << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s\n";
+    return 0;
+}
+
+static int query(const string& db_path, const string& file, const size_t max_games)
+{
+    ifstream fin;
+    if (!file.empty())
+    {
+        fin.open(file);
+        if (!fin)
+        {
+            cerr << "can't open " << file << "\n";
+            return 1;
+        }
+    }
+    istream& in = file.empty() ? cin : fin;
+
+    PositionDb db(db_path);
+    string text;
+    for (size_t id = 1; getline(in, text); ++id)
+    {
+        const auto first = text.find_first_not_of(" \t\r");
+        if (first == string::npos || text[first] == '#')
+            continue;
+        json res;
+        res["id"] = id;
+        res["fen"] = text.substr(first);
+        try
+        {
+            vector<vector<POS_T>> mtx;
+            bool color;
+            Fen::parse(text, mtx, color);
+            const auto start = chrono::steady_clock::now();
+            const db_key* key = db.find(mtx, color);
+            const double time_us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+            res["games"] = key ? key->games : 0;
+            res["white_wins"] = key ? key->white_wins : 0;
+            res["draws"] = key ? key->draws : 0;
+            res["black_wins"] = key ? key->black_wins : 0;
+            res["list"] = json::array();
+            for (size_t i = 0; key && i < key->count && res["list"].size() < max_games; ++i)
+            {
+                const auto& entry = db.entries(*key)[i];
+                res["list"].push_back({ { "game", entry.game }, { "ply", entry.ply }, { "offset", db.source_offset(entry.game) } });
+            }
+            res["time_us"] = time_us;
+        }
+        catch (const exception& e)
+        {
+            res["error"] = e.what();
+        }
+        cout << res.dump() << endl;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    const string usage = "usage: posdb build [--memory-mb M] DB [games]\n"
+                         "       posdb query [--games K] DB [positions]\n";
+    if (argc < 3)
+    {
+        cerr << usage;
+        return 1;
+    }
+    const string mode = argv[1];
+    size_t memory_mb = 512;
+    size_t max_games = 10;
+    vector<string> files;
+    for (int i = 2; i < argc; ++i)
+    {
+        const string arg = argv[i];
+        if (i + 1 < argc && arg == "--memory-mb")
+            memory_mb = stoul(argv[++i]);
+        else if (i + 1 < argc && arg == "--games")
+            max_games = stoul(argv[++i]);
+        else if (arg[0] != '-')
+            files.push_back(arg);
+        else
+        {
+            cerr << usage;
+            return 1;
+        }
+    }
+    if (files.empty() || files.size() > 2 || (mode != "build" && mode != "query"))
+    {
+        cerr << usage;
+        return 1;
+    }
+
+    try
+    {
+        const string input = files.size() > 1 ? files[1] : "";
+        return mode == "build" ? build(files[0], input, memory_mb) : query(files[0], input, max_games);
+    }
+    catch (const exception& e)
+    {
+        cerr << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,353 @@
+// Calibration and evaluation of ProbCut (see Logic::probcut_cut).
+//
+// probcut calibrate [--positions N] [--max-deep D] [--min-deep M] [--reductions R1,R2,...] [--out FILE]
+//     Samples N positions from bot self-play games, searches each of them with 1..D plies left
+//     (ProbCut off) and fits deep = a * shallow + b by least squares for every deep depth from M to D
+//     and shallow = deep - R for every reduction R (4 by default; more than one gives multi-ProbCut).
+//     Won and lost positions are left out of the fit. The pairs are written to FILE (probcut.json by default)
+//     as Logic loads them, a table with the correlations goes to stderr.
+// probcut match [--games N] [--level L] [--threshold T] [--file FILE]
+//     N games at level L of the bot with ProbCut (pairs of FILE, threshold T or the configured one) against
+//     the bot without it, every random opening played with both colors. Reports the score, the Elo
+//     difference with its 95% interval and the nodes and time per turn of both bots.
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <nlohmann/json.hpp>
+
+#include "../Game/Fen.h"
+#include "../Game/Logic.h"
+
+using json = nlohmann::json;
+
+struct calibration_position
+{
+    vector<vector<POS_T>> mtx;
+    bool color;
+    // score with d plies left at index d, 0 unused
+    vector<double> scores;
+};
+
+// Plays a game bot against bot at a low level from the start (the choice between equal turns is random)
+// and calls on_position with every position after the first turns
+template <class OnPosition>
+static void self_play(Board& board, Logic& logic, const int max_turns, OnPosition on_position)
+{
+    vector<vector<POS_T>> mtx;
+    bool color;
+    Fen::parse("start", mtx, color);
+    board.history.clear();
+    board.history.push(Zobrist::hash(mtx, color), false);
+    logic.Max_depth = 2;
+    for (int turn_num = 0; turn_num < max_turns && !logic.is_game_drawn(); ++turn_num)
+    {
+        const auto hops = logic.find_best_turns(mtx, color);
+        if (hops.empty())
+            break;
+        if (turn_num >= 4 && !on_position(mtx, color))
+            break;
+        move_seq seq;
+        for (const auto& hop : hops)
+            seq.push_back(hop);
+        const bool reversible = Logic::is_reversible(mtx, seq);
+        mtx = logic.make_turn(mtx, seq);
+        color = !color;
+        board.history.push(Zobrist::hash(mtx, color), reversible);
+    }
+}
+
+static int calibrate(Config& config, const size_t positions, const int max_deep, const int min_deep,
+    const vector<int>& reductions, const string& out_path)
+{
+    Board board;
+    Logic logic(&board, &config);
+    logic.probcut.clear();
+    const int max_turns = config("Game", "MaxNumTurns");
+
+    // every 7th position of a game, so that one game does not give many similar positions
+    vector<calibration_position> samples;
+    for (unsigned game = 0; samples.size() < positions; ++game)
+    {
+        logic.seed(game);
+        size_t index = 0;
+        self_play(board, logic, max_turns, [&](const vector<vector<POS_T>>& mtx, const bool color) {
+            if (index++ % 7 == 0)
+                samples.push_back({ mtx, color, {} });
+            return samples.size() < positions;
+        });
+    }
+
+    const auto start = chrono::steady_clock::now();
+    board.history.clear();
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        auto& s = samples[i];
+        search_limits limits;
+        limits.depth = max_deep - 1;
+        // the root of analyze has depth + 1 plies left
+        logic.analyze(s.mtx, s.color, 1, limits, [&](const analysis_result& res) {
+            if (!res.lines.empty())
+                s.scores.push_back(res.lines[0].score);
+        });
+        s.scores.insert(s.scores.begin(), 0);
+        if ((i + 1) % 50 == 0)
+            cerr << i + 1 << " positions searched, "
+                 << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s\n";
+    }
+
+    json res;
+    res["board_size"] = Russian::Size;
+    res["positions"] = samples.size();
+    res["optimization"] = config("Bot", "Optimization");
+    res["pairs"] = json::array();
+    cerr << " deep shallow      a        b      sigma     r   samples\n";
+    for (int deep = min_deep; deep <= max_deep; ++deep)
+    {
+        for (const int reduction : reductions)
+        {
+            const int shallow = deep - reduction;
+            if (shallow < 1 || reduction < 1)
+                continue;
+            double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+            for (const auto& s : samples)
+            {
+                if (int(s.scores.size()) <= deep)
+                    continue;
+                const double x = s.scores[shallow], y = s.scores[deep];
+                if (abs(x) >= INF || abs(y) >= INF)
+                    continue;
+                n += 1;
+                sx += x;
+                sy += y;
+                sxx += x * x;
+                sxy += x * y;
+                syy += y * y;
+            }
+            const double vx = sxx - sx * sx / n, vy = syy - sy * sy / n, cxy = sxy - sx * sy / n;
+            if (n < 10 || vx <= 0 || vy <= 0)
+                continue;
+            const double a = cxy / vx;
+            const double b = (sy - a * sx) / n;
+            const double sigma = sqrt(max(0.0, (vy - a * cxy) / (n - 2)));
+            const double r = cxy / sqrt(vx * vy);
+            res["pairs"].push_back({ { "deep", deep }, { "shallow", shallow }, { "a", a }, { "b", b }, { "sigma", sigma },
+                { "r", r }, { "samples", size_t(n) } });
+            cerr << setw(5) << deep << setw(8) << shallow << fixed << setprecision(4) << setw(9) << a << setw(9) << b
+                 << setw(9) << sigma << setw(7) << setprecision(3) << r << setw(9) << size_t(n) << "\n";
+        }
+    }
+
+    ofstream fout(out_path, ios_base::trunc);
+    fout << res.dump(2) << "\n";
+    if (!fout)
+    {
+        cerr << "can't write " << out_path << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+struct side_stats
+{
+    size_t turns = 0;
+    size_t nodes = 0;
+    double seconds = 0;
+};
+
+// Plays one game from the opening, bots[0] is white. Returns the score of white: 1, 0.5 or 0.
+static double play_match_game(Board& board, Logic* bots[2], side_stats stats[2], const vector<move_seq>& opening,
+    const int max_turns)
+{
+    vector<vector<POS_T>> mtx;
+    bool color;
+    Fen::parse("start", mtx, color);
+    board.history.clear();
+    board.history.push(Zobrist::hash(mtx, color), false);
+    for (int turn_num = 0; turn_num < max_turns; ++turn_num)
+    {
+        if (bots[0]->is_game_drawn())
+            return 0.5;
+        move_seq seq;
+        if (size_t(turn_num) < opening.size())
+        {
+            seq = opening[turn_num];
+        }
+        else
+        {
+            const auto start = chrono::steady_clock::now();
+            const auto hops = bots[color]->find_best_turns(mtx, color);
+            stats[color].seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (hops.empty())
+                return color ? 1 : 0;
+            ++stats[color].turns;
+            stats[color].nodes += bots[color]->nodes;
+            for (const auto& hop : hops)
+                seq.push_back(hop);
+        }
+        const bool reversible = Logic::is_reversible(mtx, seq);
+        mtx = bots[0]->make_turn(mtx, seq);
+        color = !color;
+        board.history.push(Zobrist::hash(mtx, color), reversible);
+    }
+    return 0.5;
+}
+
+static int match(Config& config, const size_t games, const int level, double threshold, const string& file)
+{
+    Board board;
+    // both bots play on one board, its history has the positions of the game
+    Logic with(&board, &config), without(&board, &config);
+    if (threshold <= 0)
+        threshold = config("Bot", "ProbCutThreshold");
+    with.probcut = Logic::load_probcut(file);
+    with.probcut_threshold = threshold;
+    without.probcut.clear();
+    if (with.probcut.empty() || threshold <= 0)
+    {
+        cerr << "no ProbCut pairs in " << file << " or no threshold\n";
+        return 1;
+    }
+    with.Max_depth = without.Max_depth = level;
+    const int max_turns = config("Game", "MaxNumTurns");
+
+    std::default_random_engine rand_eng(1);
+    side_stats stats[2];
+    double score = 0, score_sq = 0;
+    size_t wins = 0, draws = 0, losses = 0;
+    vector<move_seq> opening;
+    for (size_t game = 0; game < games; ++game)
+    {
+        // 6 random turns, then the same opening with the colors switched
+        const bool with_color = game % 2;
+        if (!with_color)
+        {
+            opening.clear();
+            vector<vector<POS_T>> mtx;
+            bool color;
+            Fen::parse("start", mtx, color);
+            while (opening.size() < 6)
+            {
+                const auto seqs = with.find_sequences(mtx, color);
+                if (seqs.empty())
+                    break;
+                opening.push_back(seqs[rand_eng() % seqs.size()]);
+                mtx = with.make_turn(mtx, opening.back());
+                color = !color;
+            }
+        }
+        with.seed(unsigned(game));
+        without.seed(unsigned(game));
+        Logic* bots[2] = { with_color ? &without : &with, with_color ? &with : &without };
+        side_stats game_stats[2];
+        const double white = play_match_game(board, bots, game_stats, opening, max_turns);
+        const double s = with_color ? 1 - white : white;
+        score += s;
+        score_sq += s * s;
+        wins += (s == 1);
+        draws += (s == 0.5);
+        losses += (s == 0);
+        for (int c = 0; c < 2; ++c)
+        {
+            auto& side = stats[bots[c] == &with ? 0 : 1];
+            side.turns += game_stats[c].turns;
+            side.nodes += game_stats[c].nodes;
+            side.seconds += game_stats[c].seconds;
+        }
+        cerr << "game " << game + 1 << ": " << s << "\n";
+    }
+
+    // Elo of the score fraction p and its 95% interval from the variance of the game scores
+    const double n = double(games);
+    const double p = score / n;
+    const double se = sqrt(max(0.0, score_sq / n - p * p) / n);
+    auto elo = [](const double p) {
+        const double q = min(max(p, 1e-3), 1 - 1e-3);
+        return -400 * log10(1 / q - 1);
+    };
+    json res;
+    res["games"] = games;
+    res["level"] = level;
+    res["threshold"] = threshold;
+    res["wins"] = wins;
+    res["draws"] = draws;
+    res["losses"] = losses;
+    res["score"] = p;
+    res["elo"] = elo(p);
+    res["elo_low"] = elo(p - 1.96 * se);
+    res["elo_high"] = elo(p + 1.96 * se);
+    const char* names[2] = { "probcut", "plain" };
+    for (int i = 0; i < 2; ++i)
+    {
+        res[names[i]] = { { "turns", stats[i].turns },
+            { "nodes_per_turn", stats[i].turns ? double(stats[i].nodes) / stats[i].turns : 0 },
+            { "ms_per_turn", stats[i].turns ? 1000 * stats[i].seconds / stats[i].turns : 0 } };
+    }
+    const double plain_nodes = res["plain"]["nodes_per_turn"];
+    res["nodes_saved"] = plain_nodes > 0 ? 1 - double(res["probcut"]["nodes_per_turn"]) / plain_nodes : 0;
+    cout << res.dump(2) << endl;
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    const string usage = "usage: probcut calibrate [--positions N] [--max-deep D] [--min-deep M] [--reductions R1,R2,...]\n"
+                         "                         [--out FILE]\n"
+                         "       probcut match [--games N] [--level L] [--threshold T] [--file FILE]\n";
+    if (argc < 2)
+    {
+        cerr << usage;
+        return 1;
+    }
+    const string mode = argv[1];
+    size_t positions = 400, games = 100;
+    int max_deep = 9, min_deep = 4, level = 6;
+    double threshold = 0;
+    vector<int> reductions = { 4 };
+    string file = project_path + "probcut.json";
+    for (int i = 2; i < argc; ++i)
+    {
+        const string arg = argv[i];
+        if (i + 1 < argc && arg == "--positions")
+            positions = stoul(argv[++i]);
+        else if (i + 1 < argc && arg == "--max-deep")
+            max_deep = min(stoi(argv[++i]), Max_search_depth + 1);
+        else if (i + 1 < argc && arg == "--min-deep")
+            min_deep = stoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--reductions")
+        {
+            reductions.clear();
+            stringstream list(argv[++i]);
+            string item;
+            while (getline(list, item, ','))
+                reductions.push_back(stoi(item));
+        }
+        else if (i + 1 < argc && (arg == "--out" || arg == "--file"))
+            file = argv[++i];
+        else if (i + 1 < argc && arg == "--games")
+            games = stoul(argv[++i]);
+        else if (i + 1 < argc && arg == "--level")
+            level = stoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--threshold")
+            threshold = stod(argv[++i]);
+        else
+        {
+            cerr << usage;
+            return 1;
+        }
+    }
+    if (mode != "calibrate" && mode != "match")
+    {
+        cerr << usage;
+        return 1;
+    }
+
+    Config config;
+    if (config("Bot", "Optimization") == "O0")
+    {
+        cerr << "ProbCut needs alpha-beta search, set Optimization to O1 or O2\n";
+        return 1;
+    }
+    return mode == "calibrate" ? calibrate(config, positions, max_deep, min_deep, reductions, file)
+                               : match(config, games, level, threshold, file);
+}
@@ -0,0 +1,69 @@
+// Checks the move generation on positions whose turns are known, mostly long capture series with many paths:
+// the number of paths of the player's turn input (all_paths), of distinct turns and the captures of the longest
+// series, for both variants. Prints one line per position and exits with 1 if any of them differs.
+//
+// rules
+
+#include <iostream>
+
+#include "../Game/Fen.h"
+#include "../Game/Logic.h"
+
+// A position and what its turns must be
+struct rules_case
+{
+    string fen;
+    size_t paths;
+    size_t turns;
+    size_t longest;
+};
+
+template <class V> static bool check(const string& variant, const vector<rules_case>& cases)
+{
+    Config config;
+    BasicBoard<V> board;
+    BasicLogic<V> logic(&board, &config);
+    bool ok = true;
+    for (const auto& c : cases)
+    {
+        vector<vector<POS_T>> mtx;
+        bool color;
+        BasicFen<V>::parse(c.fen, mtx, color);
+        const auto paths = logic.find_sequences(mtx, color, true);
+        const auto turns = logic.find_sequences(mtx, color);
+        size_t longest = 0;
+        for (const auto& seq : paths)
+            longest = max(longest, size_t(seq.size));
+        const bool same = (paths.size() == c.paths && turns.size() == c.turns && longest == c.longest);
+        cout << (same ? "ok   " : "FAIL ") << variant << " " << c.fen << ": paths " << paths.size() << " (" << c.paths
+             << "), turns " << turns.size() << " (" << c.turns << "), longest " << longest << " (" << c.longest << ")\n";
+        ok = ok && same;
+    }
+    return ok;
+}
+
+int main()
+{
+    try
+    {
+        // queens capturing around the board: more paths than a turn list holds
+        const bool russian = check<Russian>("Russian", {
+            { "start", 7, 7, 1 },
+            { "W:WK10,K27:BK6,K7,8,14,K15,16,K21,22,K23,24", 263, 129, 9 },
+        });
+        // majority rule: only the 16-piece series count, shorter ones found first must not be turns; captured
+        // checkers stay on the board until the series ends, so the jumped 9 blocks the way back to 18. The
+        // counts agree with a separate brute force generator of the International rules.
+        const bool international = check<International>("International", {
+            { "start", 9, 9, 1 },
+            { "W:WK3,K6,K45:B7,8,K9,10,K17,K18,K19,K20,K27,K28,30,33,34,K37,43,K44", 22, 1, 16 },
+            { "W:WK13:B9,18", 5, 5, 1 },
+        });
+        return (russian && international) ? 0 : 1;
+    }
+    catch (const exception& e)
+    {
+        cerr << e.what() << "\n";
+        return 1;
+    }
+}
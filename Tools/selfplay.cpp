@@ -0,0 +1,194 @@
+// Distributed bot self-play, see Game/SelfPlay.h.
+//
+// selfplay coordinator [--port P | --unix PATH] [--any] [--games N] [--level L] [--opening K] [--max-turns M]
+//                      [--seed S] [--lease-s T] OUT
+//     Hands the N games out to the workers that connect and appends their results to OUT. Started again
+//     on OUT it plays only the games missing there (the job options must be the same). Listens on
+//     127.0.0.1 unless --any. Prints a summary with the games per hour when all games are played.
+// selfplay worker [--host H] [--port P | --unix PATH] [--threads N] [--cache FILE]
+//     Plays the games of the coordinator on N threads until it has no more. With --cache every thread keeps a
+//     search cache (SearchCacheMB, 16 MB if 0) starting from FILE and writes it to FILE.<pid>.<thread> at the
+//     end, to be combined by Tools/cache merge.
+// selfplay local --workers W [--threads N] [--cache FILE] [job options] OUT
+//     The coordinator with W worker processes on this machine; a worker that dies is started again.
+// selfplay report FILE
+//     The job and the results of a results file.
+
+#include <csignal>
+#include <iomanip>
+#include <sys/wait.h>
+
+#include "../Game/SelfPlay.h"
+
+SelfPlay::Coordinator* coordinator = nullptr;
+
+void on_signal(int)
+{
+    if (coordinator)
+        coordinator->stop = true;
+}
+
+static int run_worker(Config& config, const string& host, const int port, const string& unix_path,
+                      const size_t threads, const string& cache)
+{
+    SelfPlay::Worker worker(&config, threads);
+    if (!cache.empty())
+    {
+        const size_t cache_mb = config("Bot", "SearchCacheMB");
+        worker.use_caches(cache_mb ? cache_mb : 16, cache);
+    }
+    if (!(unix_path.empty() ? worker.connect_tcp(host, port) : worker.connect_unix(unix_path)))
+    {
+        cerr << "can't connect to " << (unix_path.empty() ? host + ":" + to_string(port) : unix_path) << "\n";
+        return 1;
+    }
+    const bool finished = worker.run();
+    if (!cache.empty() && !worker.save_caches(cache))
+        cerr << "can't write the caches to " << cache << ".*\n";
+    return finished ? 0 : 1;
+}
+
+static int report(const string& path)
+{
+    selfplay_job job;
+    const auto games = SelfPlay::read_results(path, job);
+    size_t results[3] = { 0, 0, 0 }, turns = 0;
+    uint64_t nodes = 0, ms = 0;
+    for (const auto& game : games)
+    {
+        ++results[game.result % 3];
+        turns += game.turns.size();
+        nodes += game.nodes;
+        ms += game.ms;
+    }
+    const double n = max<size_t>(1, games.size());
+    cout << "job: " << job.games << " games, level " << int(job.level) << ", " << int(job.opening_turns)
+         << " opening turns, " << job.max_turns << " turns at most, seed " << job.seed << "\n";
+    cout << "played " << games.size() << ": white " << results[1] << ", black " << results[2] << ", draws "
+         << results[0] << "\n";
+    cout << fixed << setprecision(1) << "per game: " << turns / n << " turns, " << nodes / n << " nodes, "
+         << ms / n / 1000 << " s of one thread\n";
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    const string usage =
+        "usage: selfplay coordinator [--port P | --unix PATH] [--any] [--games N] [--level L] [--opening K]\n"
+        "                            [--max-turns M] [--seed S] [--lease-s T] OUT\n"
+        "       selfplay worker [--host H] [--port P | --unix PATH] [--threads N] [--cache FILE]\n"
+        "       selfplay local --workers W [--threads N] [--cache FILE] [--games N] [--level L] [--opening K]\n"
+        "                      [--max-turns M] [--seed S] [--lease-s T] OUT\n"
+        "       selfplay report FILE\n";
+    if (argc < 2)
+    {
+        cerr << usage;
+        return 1;
+    }
+    const string mode = argv[1];
+    int port = 7071;
+    string host = "127.0.0.1", unix_path, out, cache;
+    bool any_address = false;
+    size_t threads = max(1u, thread::hardware_concurrency()), workers = 0;
+    double lease_s = 120;
+    selfplay_job job;
+    job.games = 100;
+    for (int i = 2; i < argc; ++i)
+    {
+        const string arg = argv[i];
+        if (i + 1 < argc && arg == "--port")
+            port = stoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--unix")
+            unix_path = argv[++i];
+        else if (i + 1 < argc && arg == "--host")
+            host = argv[++i];
+        else if (arg == "--any")
+            any_address = true;
+        else if (i + 1 < argc && arg == "--threads")
+            threads = max<size_t>(1, stoul(argv[++i]));
+        else if (i + 1 < argc && arg == "--cache")
+            cache = argv[++i];
+        else if (i + 1 < argc && arg == "--workers")
+            workers = stoul(argv[++i]);
+        else if (i + 1 < argc && arg == "--games")
+            job.games = stoul(argv[++i]);
+        else if (i + 1 < argc && arg == "--level")
+            job.level = uint8_t(stoi(argv[++i]));
+        else if (i + 1 < argc && arg == "--opening")
+            job.opening_turns = uint8_t(stoi(argv[++i]));
+        else if (i + 1 < argc && arg == "--max-turns")
+            job.max_turns = uint16_t(stoi(argv[++i]));
+        else if (i + 1 < argc && arg == "--seed")
+            job.seed = stoull(argv[++i]);
+        else if (i + 1 < argc && arg == "--lease-s")
+            lease_s = stod(argv[++i]);
+        else if (arg[0] != '-' && out.empty())
+            out = argv[i];
+        else
+        {
+            cerr << usage;
+            return 1;
+        }
+    }
+    const bool needs_out = (mode == "coordinator" || mode == "local" || mode == "report");
+    if ((mode != "worker" && !needs_out) || needs_out == out.empty() || (mode == "local" && !workers))
+    {
+        cerr << usage;
+        return 1;
+    }
+
+    try
+    {
+        if (mode == "report")
+            return report(out);
+        Config config;
+        if (mode == "worker")
+            return run_worker(config, host, port, unix_path, threads, cache);
+
+        SelfPlay::Coordinator coord(job, out, lease_s);
+        // the local workers always use a free port of the loopback
+        if (mode == "local")
+            unix_path.clear(), port = 0, any_address = false;
+        if (!(unix_path.empty() ? coord.listen_tcp(port, any_address) : coord.listen_unix(unix_path)))
+        {
+            cerr << "can't listen on " << (unix_path.empty() ? "port " + to_string(port) : unix_path) << "\n";
+            return 1;
+        }
+        coordinator = &coord;
+        signal(SIGINT, on_signal);
+        signal(SIGTERM, on_signal);
+
+        vector<pid_t> children(workers, -1);
+        const auto spawn = [&](pid_t& pid) {
+            pid = fork();
+            if (pid == 0)
+            {
+                // an interrupt stops the workers at once, the coordinator gives their games back
+                signal(SIGINT, SIG_DFL);
+                signal(SIGTERM, SIG_DFL);
+                _exit(run_worker(config, "127.0.0.1", coord.port(), "", threads, cache));
+            }
+        };
+        const auto keep_workers = [&] {
+            for (auto& pid : children)
+            {
+                int status;
+                if (pid == -1 || waitpid(pid, &status, WNOHANG) == pid)
+                    spawn(pid);
+            }
+        };
+        const bool finished = coord.run(mode == "local" ? function<void()>(keep_workers) : nullptr);
+        for (const auto pid : children)
+        {
+            if (pid > 0)
+                waitpid(pid, nullptr, 0);
+        }
+        cout << coord.summary().dump(2) << endl;
+        return finished ? 0 : 2;
+    }
+    catch (const exception& e)
+    {
+        cerr << e.what() << "\n";
+        return 1;
+    }
+}
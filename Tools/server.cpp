@@ -0,0 +1,50 @@
+// Game server hosting many concurrent bot games, see Game/Server.h.
+//
+// server [--port P | --unix PATH] [--threads N]
+
+#include <csignal>
+
+#include "../Game/Server.h"
+
+Server* server = nullptr;
+
+void on_signal(int)
+{
+    if (server)
+        server->stop = true;
+}
+
+int main(int argc, char* argv[])
+{
+    int port = 7070;
+    string unix_path;
+    size_t threads = max(1u, thread::hardware_concurrency());
+    for (int i = 1; i < argc; ++i)
+    {
+        const string arg = argv[i];
+        if (i + 1 < argc && arg == "--port")
+            port = stoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--unix")
+            unix_path = argv[++i];
+        else if (i + 1 < argc && arg == "--threads")
+            threads = max<size_t>(1, stoul(argv[++i]));
+        else
+        {
+            cerr << "usage: server [--port P | --unix PATH] [--threads N]\n";
+            return 1;
+        }
+    }
+
+    Config config;
+    Server srv(&config, threads);
+    if (!(unix_path.empty() ? srv.listen_tcp(port) : srv.listen_unix(unix_path)))
+    {
+        cerr << "can't listen on " << (unix_path.empty() ? "port " + to_string(port) : unix_path) << "\n";
+        return 1;
+    }
+    server = &srv;
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    srv.run();
+    return 0;
+}
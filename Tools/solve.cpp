@@ -0,0 +1,137 @@
+// Exact values of positions by proof-number search, see Game/Solver.h: reads positions (one per line as in
+// analyze) from a file or stdin, solves them one by one on all threads and writes one JSON object per
+// position to stdout. With --book the proven ones are added to FILE for the search (UseSolved).
+//
+// solve [--threads N] [--memory-mb M] [--time-ms T] [--nodes K] [--quiet Q] [--book FILE] [file]
+
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+#include "../Game/Fen.h"
+#include "../Game/Solver.h"
+
+using json = nlohmann::json;
+
+static const char* value_name(const solver_result::Value value)
+{
+    switch (value)
+    {
+    case solver_result::Win:
+        return "win";
+    case solver_result::Draw:
+        return "draw";
+    case solver_result::Loss:
+        return "loss";
+    default:
+        return "unknown";
+    }
+}
+
+// Adds the positions to the book FILE, a position solved again replaces its old result
+static void add_to_book(const string& path, const vector<json>& positions)
+{
+    json book = { { "board_size", Russian::Size }, { "positions", json::array() } };
+    ifstream fin(path);
+    if (fin)
+    {
+        const json data = json::parse(fin, nullptr, false);
+        if (!data.is_discarded() && data.value("board_size", 0) == Russian::Size && data.contains("positions"))
+            book = data;
+    }
+    auto& list = book["positions"];
+    for (const auto& p : positions)
+    {
+        auto it = find_if(list.begin(), list.end(), [&](const json& old) {
+            return old["fen"] == p["fen"] && old.value("quiet", 0) == p["quiet"];
+        });
+        if (it != list.end())
+            *it = p;
+        else
+            list.push_back(p);
+    }
+    ofstream(path) << book.dump(1) << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t threads = max(1u, thread::hardware_concurrency());
+    size_t memory_mb = 256;
+    int quiet = 0;
+    search_limits limits;
+    string file, book;
+    for (int i = 1; i < argc; ++i)
+    {
+        const string arg = argv[i];
+        if (i + 1 < argc && arg == "--threads")
+            threads = max<size_t>(1, stoul(argv[++i]));
+        else if (i + 1 < argc && arg == "--memory-mb")
+            memory_mb = stoul(argv[++i]);
+        else if (i + 1 < argc && arg == "--time-ms")
+            limits.time_ms = stoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--nodes")
+            limits.nodes = stoul(argv[++i]);
+        else if (i + 1 < argc && arg == "--quiet")
+            quiet = stoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--book")
+            book = argv[++i];
+        else if (arg[0] != '-')
+            file = arg;
+        else
+        {
+            cerr << "usage: solve [--threads N] [--memory-mb M] [--time-ms T] [--nodes K] [--quiet Q] [--book FILE] [file]\n";
+            return 1;
+        }
+    }
+
+    ifstream fin;
+    if (!file.empty())
+    {
+        fin.open(file);
+        if (!fin)
+        {
+            cerr << "can't open " << file << "\n";
+            return 1;
+        }
+    }
+    istream& in = file.empty() ? cin : fin;
+
+    Config config;
+    // one table for all positions: what one proof found helps the next ones
+    Solver solver(&config, threads, memory_mb);
+    vector<json> proven;
+    string text;
+    for (size_t id = 1; getline(in, text); ++id)
+    {
+        const auto first = text.find_first_not_of(" \t\r");
+        if (first == string::npos || text[first] == '#')
+            continue;
+        json res;
+        res["id"] = id;
+        res["fen"] = text.substr(first);
+        try
+        {
+            vector<vector<POS_T>> mtx;
+            bool color;
+            Fen::parse(text, mtx, color);
+            const auto result = solver.solve(mtx, color, limits, quiet);
+            res["result"] = value_name(result.value);
+            if (!result.turn.empty())
+                res["turn"] = Fen::turn_to_string(result.turn);
+            res["nodes"] = result.nodes;
+            res["time_ms"] = result.time_ms;
+            res["nps"] = result.time_ms > 0 ? size_t(result.nodes / result.time_ms * 1000) : 0;
+            if (result.value != solver_result::Unknown)
+                proven.push_back({ { "fen", Fen::to_string(mtx, color) }, { "quiet", quiet },
+                                   { "result", value_name(result.value) } });
+        }
+        catch (const exception& e)
+        {
+            res["error"] = e.what();
+        }
+        cout << res.dump() << endl;
+    }
+    cerr << "table: " << solver.table_used() << " entries, " << solver.collections() << " garbage collections\n";
+    if (!book.empty() && !proven.empty())
+        add_to_book(book, proven);
+    return 0;
+}
@@ -0,0 +1,491 @@
+// Search trees recorded by TreeRecorder (see Game/TreeRecorder.h).
+//
+// tree record [--level L] [--sample P] [--max-mb M] OUT [positions]
+//     Searches every position of the file (or stdin, one per line, "#" starts a comment) at level L
+//     (8 by default) with the configured Optimization and records the share P of the searches (1)
+//     into OUT, at most M MB (256).
+// tree report [--top K] [--flame FILE] [--flame-depth D] IN
+//     Rebuilds the recorded trees and reports, as JSON:
+//     - per ply: nodes, leaves, legal and searched turns of the inner nodes and the effective
+//       branching factor (nodes of the next ply per node);
+//     - move ordering: how many cut nodes failed high on the first, second, third or a later turn;
+//     - work that did not decide the result: the turns searched before the one that failed high
+//       (better ordering would skip them), null window searches that had to be searched again,
+//       the iterations before the last one (with aspiration re-searches) and ProbCut probes,
+//       with the K largest such subtrees and their lines.
+//     With --flame the node counts go to FILE as folded stacks ("depth 8;22-18;11-15 1234", one frame
+//     per turn down to D turns, 4 by default) for flamegraph.pl or speedscope.
+
+#include <iostream>
+#include <map>
+#include <nlohmann/json.hpp>
+
+#include "../Game/Fen.h"
+#include "../Game/Logic.h"
+#include "../Game/TreeRecorder.h"
+
+using json = nlohmann::json;
+
+struct tree_node
+{
+    int parent = -1;
+    uint8_t ply = 0, plies_left = 0, from = TreeRecorder::No_cell, to = TreeRecorder::No_cell, hops = 0;
+    float alpha = 0, beta = 0, score = 0;
+    uint8_t legal = 0, searched = 0, flags = 0;
+    // the exit was recorded
+    bool closed = false;
+    uint64_t size = 1;
+    vector<int> children;
+};
+
+struct recorded_search
+{
+    uint32_t id = 0;
+    bool color = false;
+    int level = 0;
+    uint64_t nodes = 0;
+    // roots of the iterations (and their aspiration re-searches) in order
+    vector<int> roots;
+    vector<tree_node> tree;
+};
+
+// why a subtree did not decide the result
+enum waste_kind
+{
+    Ordering,
+    Research,
+    Iteration,
+    Probe,
+    Waste_kinds
+};
+const char* Waste_names[Waste_kinds] = { "ordering", "re-search", "earlier_iterations", "probcut_probes" };
+
+class TreeReader
+{
+public:
+    explicit TreeReader(const string& path) : fin(path, ios::binary)
+    {
+        char magic[sizeof(TreeRecorder::Magic)];
+        if (!fin.read(magic, sizeof(magic)) || memcmp(magic, TreeRecorder::Magic, sizeof(magic)) != 0)
+            throw runtime_error(path + " is not a search tree record");
+        board_size = get<uint8_t>();
+    }
+
+    // the next search, false at the end; an unfinished one (truncated file) is closed as it is
+    bool next(recorded_search& search)
+    {
+        search = recorded_search();
+        char type;
+        while (fin.get(type) && type != 'S')
+        {
+            if (type == 'T')
+                truncated = true;
+        }
+        if (!fin)
+            return false;
+        search.color = get<uint8_t>();
+        search.level = get<uint8_t>();
+        search.id = get<uint32_t>();
+        vector<int> open;
+        while (fin.get(type))
+        {
+            if (type == 'N')
+            {
+                tree_node node;
+                node.parent = open.empty() ? -1 : open.back();
+                node.ply = get<uint8_t>();
+                node.plies_left = get<uint8_t>();
+                node.from = get<uint8_t>();
+                node.to = get<uint8_t>();
+                node.hops = get<uint8_t>();
+                node.alpha = get<float>();
+                node.beta = get<float>();
+                const int index = int(search.tree.size());
+                if (node.parent < 0)
+                    search.roots.push_back(index);
+                else
+                    search.tree[node.parent].children.push_back(index);
+                search.tree.push_back(node);
+                open.push_back(index);
+            }
+            else if (type == 'X')
+            {
+                get<uint8_t>();
+                if (open.empty())
+                    throw runtime_error("broken record: exit without a node");
+                auto& node = search.tree[open.back()];
+                node.legal = get<uint8_t>();
+                node.searched = get<uint8_t>();
+                node.flags = get<uint8_t>();
+                node.score = get<float>();
+                node.closed = true;
+                open.pop_back();
+            }
+            else if (type == 'E')
+            {
+                search.nodes = get<uint64_t>();
+                break;
+            }
+            else
+            {
+                truncated |= (type == 'T');
+                break;
+            }
+            if (!fin)
+                break;
+        }
+        // children come after their parents
+        for (size_t i = search.tree.size(); i-- > 0;)
+        {
+            if (search.tree[i].parent >= 0)
+                search.tree[search.tree[i].parent].size += search.tree[i].size;
+        }
+        return true;
+    }
+
+    int board_size = 8;
+    bool truncated = false;
+
+private:
+    template <class T> T get()
+    {
+        T value{};
+        fin.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return value;
+    }
+
+    ifstream fin;
+};
+
+static int record(const string& out, const string& file, const int level, const double sample, const uint64_t max_mb)
+{
+    ifstream fin;
+    if (!file.empty())
+    {
+        fin.open(file);
+        if (!fin)
+        {
+            cerr << "can't open " << file << "\n";
+            return 1;
+        }
+    }
+    istream& in = file.empty() ? cin : fin;
+
+    Config config;
+    Board board;
+    Logic logic(&board, &config);
+    logic.Max_depth = level;
+    logic.recorder = make_shared<TreeRecorder>(out, Russian::Size, sample, max_mb << 20);
+    string text;
+    size_t searches = 0;
+    while (getline(in, text))
+    {
+        const auto first = text.find_first_not_of(" \t\r");
+        if (first == string::npos || text[first] == '#')
+            continue;
+        vector<vector<POS_T>> mtx;
+        bool color;
+        Fen::parse(text, mtx, color);
+        board.history.clear();
+        board.history.push(Zobrist::hash(mtx, color), false);
+        logic.find_best_turns(mtx, color);
+        ++searches;
+    }
+    cerr << searches << " searches" << (logic.recorder->is_full() ? ", the record is truncated" : "") << "\n";
+    return 0;
+}
+
+class Report
+{
+public:
+    Report(const int board_size, const size_t top, const int flame_depth)
+        : board_size(board_size), top(top), flame_depth(flame_depth)
+    {
+    }
+
+    void add(const recorded_search& search)
+    {
+        ++searches;
+        const auto& tree = search.tree;
+        recorded += tree.size();
+        for (size_t i = 0; i < tree.size(); ++i)
+            count_node(tree, int(i));
+        for (size_t r = 0; r < search.roots.size(); ++r)
+        {
+            const int root = search.roots[r];
+            if (r + 1 < search.roots.size())
+                add_waste(search, root, Iteration);
+            else
+                find_waste(search, root);
+            if (flame_depth >= 0)
+                add_flame(tree, root, "depth " + to_string(int(tree[root].plies_left) - 1));
+        }
+    }
+
+    json to_json(const bool truncated) const
+    {
+        json res;
+        res["searches"] = searches;
+        res["nodes"] = recorded;
+        res["truncated"] = truncated;
+        res["plies"] = json::array();
+        for (size_t ply = 0; ply < plies.size(); ++ply)
+        {
+            const auto& p = plies[ply];
+            const uint64_t next = ply + 1 < plies.size() ? plies[ply + 1].nodes : 0;
+            res["plies"].push_back({ { "ply", ply }, { "nodes", p.nodes }, { "leaves", p.leaves },
+                { "legal_turns", p.inner ? double(p.legal) / p.inner : 0 },
+                { "searched_turns", p.inner ? double(p.searched) / p.inner : 0 },
+                { "branching", p.nodes ? double(next) / p.nodes : 0 } });
+        }
+        uint64_t cut_nodes = 0, cut_index_sum = 0;
+        for (size_t i = 0; i < cutoffs.size(); ++i)
+        {
+            cut_nodes += cutoffs[i];
+            cut_index_sum += cutoffs[i] * (i + 1);
+        }
+        json ordering;
+        ordering["cut_nodes"] = cut_nodes;
+        ordering["first"] = cut_nodes ? double(cutoffs[0]) / cut_nodes : 0;
+        ordering["second"] = cut_nodes ? double(cutoffs[1]) / cut_nodes : 0;
+        ordering["third"] = cut_nodes ? double(cutoffs[2]) / cut_nodes : 0;
+        ordering["later"] = cut_nodes ? double(cutoffs[3]) / cut_nodes : 0;
+        ordering["mean_cut_turn"] = cut_nodes ? double(cut_index_sum) / cut_nodes : 0;
+        res["move_ordering"] = ordering;
+        json waste;
+        for (int k = 0; k < Waste_kinds; ++k)
+            waste[Waste_names[k]] = { { "nodes", wasted[k] }, { "share", recorded ? double(wasted[k]) / recorded : 0 } };
+        res["unneeded"] = waste;
+        res["largest_unneeded"] = json::array();
+        for (const auto& w : largest)
+        {
+            res["largest_unneeded"].push_back(
+                { { "search", w.search }, { "kind", Waste_names[w.kind] }, { "nodes", w.size }, { "line", w.line } });
+        }
+        return res;
+    }
+
+    bool save_flame(const string& path) const
+    {
+        ofstream fout(path, ios_base::trunc);
+        for (const auto& [stack, count] : flame)
+            fout << stack << " " << count << "\n";
+        return bool(fout);
+    }
+
+private:
+    struct ply_stats
+    {
+        uint64_t nodes = 0, leaves = 0, inner = 0, legal = 0, searched = 0;
+    };
+
+    struct waste
+    {
+        uint32_t search;
+        waste_kind kind;
+        uint64_t size;
+        string line;
+    };
+
+    static bool is_inner(const tree_node& node)
+    {
+        return node.closed && node.legal && !(node.flags & (TreeRecorder::Leaf | TreeRecorder::Probcut | TreeRecorder::Cached));
+    }
+
+    void count_node(const vector<tree_node>& tree, const int index)
+    {
+        const auto& node = tree[index];
+        if (plies.size() <= node.ply)
+            plies.resize(node.ply + 1);
+        auto& p = plies[node.ply];
+        ++p.nodes;
+        p.leaves += (node.flags & TreeRecorder::Leaf) != 0;
+        if (!is_inner(node))
+            return;
+        ++p.inner;
+        p.legal += node.legal;
+        p.searched += node.searched;
+        if ((node.flags & TreeRecorder::Cutoff) && !(node.flags & TreeRecorder::Stopped))
+            ++cutoffs[std::min<size_t>(node.searched, cutoffs.size()) - 1];
+    }
+
+    // The children of a node are grouped by turn: a turn searched again follows its first search.
+    // Probes of ProbCut are children at the ply of the node itself.
+    void find_waste(const recorded_search& search, const int index)
+    {
+        const auto& tree = search.tree;
+        const auto& node = tree[index];
+        vector<vector<int>> groups;
+        for (const int child : node.children)
+        {
+            const auto& c = tree[child];
+            if (c.ply == node.ply)
+            {
+                add_waste(search, child, Probe);
+                continue;
+            }
+            if (groups.empty() || tree[groups.back().back()].from != c.from || tree[groups.back().back()].to != c.to ||
+                tree[groups.back().back()].hops != c.hops)
+                groups.emplace_back();
+            groups.back().push_back(child);
+        }
+        const bool cut = (node.flags & TreeRecorder::Cutoff) && is_inner(node);
+        for (size_t g = 0; g < groups.size(); ++g)
+        {
+            const auto& group = groups[g];
+            if (cut && g + 1 < groups.size())
+            {
+                for (const int child : group)
+                    add_waste(search, child, Ordering);
+                continue;
+            }
+            for (size_t i = 0; i + 1 < group.size(); ++i)
+                add_waste(search, group[i], Research);
+            find_waste(search, group.back());
+        }
+    }
+
+    void add_waste(const recorded_search& search, const int index, const waste_kind kind)
+    {
+        const uint64_t size = search.tree[index].size;
+        wasted[kind] += size;
+        if (largest.size() >= top && (top == 0 || largest.back().size >= size))
+            return;
+        waste w{ search.id, kind, size, line(search.tree, index) };
+        largest.insert(upper_bound(largest.begin(), largest.end(), w,
+                           [](const waste& a, const waste& b) { return a.size > b.size; }),
+            w);
+        if (largest.size() > top)
+            largest.pop_back();
+    }
+
+    // the iteration and the turns from its root to the node: "depth 8: 22-18 11-15"
+    string line(const vector<tree_node>& tree, int index) const
+    {
+        vector<string> turns;
+        for (; tree[index].parent >= 0; index = tree[index].parent)
+        {
+            const auto& node = tree[index];
+            turns.push_back(tree[node.parent].ply == node.ply ? "(probcut)" : turn(node));
+        }
+        string res = "depth " + to_string(int(tree[index].plies_left) - 1) + ":";
+        for (auto it = turns.rbegin(); it != turns.rend(); ++it)
+            res += " " + *it;
+        return res;
+    }
+
+    string turn(const tree_node& node) const
+    {
+        auto square = [&](const int cell) {
+            const int x = cell / board_size, y = cell % board_size;
+            return board_size == International::Size ? BasicFen<International>::square(x, y) : Fen::square(x, y);
+        };
+        return to_string(square(node.from)) + (node.hops ? "x" : "-") + to_string(square(node.to));
+    }
+
+    // Folded stacks: every node above flame_depth turns counts for its own frame, a node at that depth
+    // counts its whole subtree
+    void add_flame(const vector<tree_node>& tree, const int index, const string& stack, const int depth = 0)
+    {
+        const auto& node = tree[index];
+        if (depth >= flame_depth)
+        {
+            flame[stack] += node.size;
+            return;
+        }
+        flame[stack] += 1;
+        for (const int child : node.children)
+        {
+            const auto& c = tree[child];
+            const string frame = (c.ply == node.ply) ? "probcut" : turn(c);
+            add_flame(tree, child, stack + ";" + frame, depth + 1);
+        }
+    }
+
+    int board_size;
+    size_t top;
+    int flame_depth;
+    uint64_t searches = 0;
+    uint64_t recorded = 0;
+    vector<ply_stats> plies;
+    // cut nodes by the turn that failed high: first, second, third, later
+    array<uint64_t, 4> cutoffs{};
+    uint64_t wasted[Waste_kinds]{};
+    vector<waste> largest;
+    map<string, uint64_t> flame;
+};
+
+static int report(const string& path, const size_t top, const string& flame_path, const int flame_depth)
+{
+    TreeReader reader(path);
+    Report rep(reader.board_size, top, flame_path.empty() ? -1 : flame_depth);
+    recorded_search search;
+    while (reader.next(search))
+        rep.add(search);
+    cout << rep.to_json(reader.truncated).dump(2) << endl;
+    if (!flame_path.empty() && !rep.save_flame(flame_path))
+    {
+        cerr << "can't write " << flame_path << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    const string usage = "usage: tree record [--level L] [--sample P] [--max-mb M] OUT [positions]\n"
+                         "       tree report [--top K] [--flame FILE] [--flame-depth D] IN\n";
+    if (argc < 3)
+    {
+        cerr << usage;
+        return 1;
+    }
+    const string mode = argv[1];
+    int level = 8, flame_depth = 4;
+    double sample = 1;
+    uint64_t max_mb = 256;
+    size_t top = 10;
+    string flame_path;
+    vector<string> files;
+    for (int i = 2; i < argc; ++i)
+    {
+        const string arg = argv[i];
+        if (i + 1 < argc && arg == "--level")
+            level = stoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--sample")
+            sample = stod(argv[++i]);
+        else if (i + 1 < argc && arg == "--max-mb")
+            max_mb = stoull(argv[++i]);
+        else if (i + 1 < argc && arg == "--top")
+            top = stoul(argv[++i]);
+        else if (i + 1 < argc && arg == "--flame")
+            flame_path = argv[++i];
+        else if (i + 1 < argc && arg == "--flame-depth")
+            flame_depth = stoi(argv[++i]);
+        else if (arg[0] != '-')
+            files.push_back(arg);
+        else
+        {
+            cerr << usage;
+            return 1;
+        }
+    }
+    if (files.empty() || (mode == "record" && files.size() > 2) || (mode == "report" && files.size() != 1) ||
+        (mode != "record" && mode != "report"))
+    {
+        cerr << usage;
+        return 1;
+    }
+
+    try
+    {
+        if (mode == "record")
+            return record(files[0], files.size() > 1 ? files[1] : "", level, sample, max_mb);
+        return report(files[0], top, flame_path, flame_depth);
+    }
+    catch (const exception& e)
+    {
+        cerr << e.what() << "\n";
+        return 1;
+    }
+}
@@ -5,8 +5,17 @@
 
 int main(int argc, char* argv[])
 {
-    Game g;
-    g.play();
+    // the variant is chosen once, every variant has its own compiled game
+    if (Config()("Game", "Variant") == "International")
+    {
+        BasicGame<International> g;
+        g.play();
+    }
+    else
+    {
+        Game g;
+        g.play();
+    }
 
     return 0;
 }